@@ -0,0 +1,591 @@
+// Headless benchmarks for the dependency graph, on synthetic graphs of pure CPU numeric nodes.
+// Prints one json document to stdout, so results can be stored and compared between versions.
+//
+// Usage: dg_bench [--size N] [--iterations N] [--seed N] [generator...]
+// Generators: chain, fan, diamond, random, arrays, async. All of them run if none are given.
+
+#include "../dg.h"
+#include "../dg_async.h"
+#include "../dg_dense.h"
+#include "../dg_io.h"
+#include "../dg_json_stream.h"
+#include "../dg_registry.h"
+#include "../dg_schedule.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <thread>
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+    char BenchF32[] = "BenchF32";
+}
+
+class F32BenchSocket : public Socket<float, F32BenchSocket, BenchF32> {
+public:
+    using Socket::Socket;
+
+protected:
+    bool deserializeValue(const TTJson::Value& value) override {
+        if (value.isDouble())
+            setValue((float)value.asDouble());
+        else if (value.isInt())
+            setValue((float)value.asInt());
+        else
+            return false;
+        return true;
+    }
+
+    TTJson::Value serializeValue() const override { return (double)_value; }
+};
+
+// Where changes enter the graph.
+class ValueF32Node final : public Node {
+public:
+    std::string typeName() const override { return "ValueF32Node"; }
+
+    F32BenchSocket& value;
+    F32BenchSocket& result;
+
+    ValueF32Node(const std::string& label = "")
+        : Node(label)
+        , value(addInput<F32BenchSocket>("value", 1.0f))
+        , result(addOutput<F32BenchSocket>("result", 0.0f)) {
+        _initializing = false;
+    }
+
+private:
+    void _compute() override { result.setValue(value.value()); }
+};
+
+class AddF32Node final : public Node {
+public:
+    std::string typeName() const override { return "AddF32Node"; }
+
+    F32BenchSocket& lhs;
+    F32BenchSocket& rhs;
+    F32BenchSocket& result;
+
+    AddF32Node(const std::string& label = "")
+        : Node(label)
+        , lhs(addInput<F32BenchSocket>("lhs", 0.0f))
+        , rhs(addInput<F32BenchSocket>("rhs", 1.0f))
+        , result(addOutput<F32BenchSocket>("result", 0.0f)) {
+        _initializing = false;
+    }
+
+private:
+    // Averaging keeps the values bounded however deep the graph gets.
+    void _compute() override { result.setValue((lhs.value() + rhs.value()) * 0.5f); }
+};
+
+class SumF32Node final : public Node {
+public:
+    std::string typeName() const override { return "SumF32Node"; }
+
+    SocketArray<F32BenchSocket>& values;
+    F32BenchSocket& result;
+
+    SumF32Node(const std::string& label = "")
+        : Node(label)
+        , values(addArrayInput<F32BenchSocket>("values", 0.0f))
+        , result(addOutput<F32BenchSocket>("result", 0.0f)) {
+        _initializing = false;
+    }
+
+private:
+    void _compute() override {
+        float sum = 0.0f;
+        for (const F32BenchSocket* value : values.children())
+            sum += ((F32BenchSocket*)value)->value();
+        result.setValue(values.children().empty() ? 0.0f : sum / (float)values.children().size());
+    }
+};
+
+// Integrates sin(value * x) over [0, 1] in the background, standing in for expensive work like decoding a file.
+class IntegrateF32Node final : public AsyncNode {
+public:
+    std::string typeName() const override { return "IntegrateF32Node"; }
+
+    F32BenchSocket& value;
+    F32BenchSocket& result;
+
+    static size_t sSteps;
+
+    IntegrateF32Node(const std::string& label = "")
+        : AsyncNode(label)
+        , value(addInput<F32BenchSocket>("value", 1.0f))
+        , result(addOutput<F32BenchSocket>("result", 0.0f)) {
+        _initializing = false;
+    }
+
+private:
+    Work _start() override {
+        double frequency = value.value();
+        size_t steps = sSteps;
+        return [this, frequency, steps](const Cancellation& cancellation) -> Finish {
+            double sum = 0.0;
+            for (size_t i = 0; i < steps; ++i) {
+                if ((i & 0xFFF) == 0 && cancellation.cancelled())
+                    return Finish();
+                sum += std::sin(frequency * ((double)i + 0.5) / (double)steps);
+            }
+            float integral = (float)(sum / (double)steps);
+            return [this, integral]() { result.setValue(integral); };
+        };
+    }
+};
+
+size_t IntegrateF32Node::sSteps = 1 << 18;
+
+TT_DG_REGISTER_SOCKET(F32BenchSocket, 0.0f)
+TT_DG_REGISTER_NODE(ValueF32Node)
+TT_DG_REGISTER_NODE(AddF32Node)
+TT_DG_REGISTER_NODE(SumF32Node)
+TT_DG_REGISTER_NODE(IntegrateF32Node)
+
+namespace {
+    struct BenchGraph {
+        GraphArena arena;
+        std::vector<Node*> nodes;
+        std::vector<ValueF32Node*> roots;
+        std::vector<Node*> sinks;
+
+        template<typename T> T& create() {
+            T& node = arena.create<T>();
+            nodes.push_back(&node);
+            return node;
+        }
+    };
+
+    typedef std::function<void(BenchGraph&, size_t, std::mt19937&)> Generator;
+
+    // root -> add -> add -> ...
+    void generateChain(BenchGraph& graph, size_t size, std::mt19937&) {
+        ValueF32Node& root = graph.create<ValueF32Node>();
+        graph.roots.push_back(&root);
+        F32BenchSocket* previous = &root.result;
+        for (size_t i = 1; i < size; ++i) {
+            AddF32Node& node = graph.create<AddF32Node>();
+            node.lhs.setInput(*previous);
+            previous = &node.result;
+        }
+        graph.sinks.push_back(&previous->node());
+    }
+
+    // One root read by every add, all of which are summed by one node.
+    void generateFan(BenchGraph& graph, size_t size, std::mt19937&) {
+        ValueF32Node& root = graph.create<ValueF32Node>();
+        graph.roots.push_back(&root);
+        std::vector<AddF32Node*> adds;
+        for (size_t i = 2; i < size; ++i) {
+            adds.push_back(&graph.create<AddF32Node>());
+            adds.back()->lhs.setInput(root.result);
+        }
+        SumF32Node& sum = graph.create<SumF32Node>();
+        for (AddF32Node* node : adds)
+            sum.values.appendNew().setInput(node->result);
+        graph.sinks.push_back(&sum);
+    }
+
+    // A chain of diamonds: every stage splits in two and joins again.
+    void generateDiamond(BenchGraph& graph, size_t size, std::mt19937&) {
+        ValueF32Node& root = graph.create<ValueF32Node>();
+        graph.roots.push_back(&root);
+        F32BenchSocket* previous = &root.result;
+        for (size_t i = 1; i + 3 <= size; i += 3) {
+            AddF32Node& left = graph.create<AddF32Node>();
+            AddF32Node& right = graph.create<AddF32Node>();
+            AddF32Node& join = graph.create<AddF32Node>();
+            left.lhs.setInput(*previous);
+            right.lhs.setInput(*previous);
+            join.lhs.setInput(left.result);
+            join.rhs.setInput(right.result);
+            previous = &join.result;
+        }
+        graph.sinks.push_back(&previous->node());
+    }
+
+    // Random connections that respect a random topological order, so nodes are not created in evaluation order.
+    void generateRandom(BenchGraph& graph, size_t size, std::mt19937& rng) {
+        size_t rootCount = std::max<size_t>(1, size / 100);
+        std::vector<Node*> order;
+        for (size_t i = 0; i < rootCount; ++i) {
+            ValueF32Node& root = graph.create<ValueF32Node>();
+            graph.roots.push_back(&root);
+            order.push_back(&root);
+        }
+        std::vector<AddF32Node*> adds;
+        for (size_t i = rootCount; i < size; ++i)
+            adds.push_back(&graph.create<AddF32Node>());
+        std::shuffle(adds.begin(), adds.end(), rng);
+        order.insert(order.end(), adds.begin(), adds.end());
+
+        auto output = [&](Node* node) -> F32BenchSocket& {
+            if (ValueF32Node* root = dynamic_cast<ValueF32Node*>(node))
+                return root->result;
+            return ((AddF32Node*)node)->result;
+        };
+        std::vector<char> read(order.size(), 0);
+        for (size_t i = rootCount; i < order.size(); ++i) {
+            AddF32Node& node = *(AddF32Node*)order[i];
+            size_t lhs = rng() % i;
+            size_t rhs = rng() % i;
+            node.lhs.setInput(output(order[lhs]));
+            node.rhs.setInput(output(order[rhs]));
+            read[lhs] = read[rhs] = 1;
+        }
+        for (size_t i = 0; i < order.size(); ++i)
+            if (!read[i])
+                graph.sinks.push_back(order[i]);
+    }
+
+    // Layers of sums, every sum reads a handful of random nodes of the layer before it through its array.
+    void generateArrays(BenchGraph& graph, size_t size, std::mt19937& rng) {
+        const size_t width = 64;
+        const size_t fanIn = 8;
+        std::vector<F32BenchSocket*> previous;
+        for (size_t i = 0; i < width && i < size; ++i) {
+            ValueF32Node& root = graph.create<ValueF32Node>();
+            graph.roots.push_back(&root);
+            previous.push_back(&root.result);
+        }
+        std::vector<F32BenchSocket*> layer;
+        for (size_t count = previous.size(); count < size;) {
+            layer.clear();
+            for (size_t i = 0; i < width && count < size; ++i, ++count) {
+                SumF32Node& sum = graph.create<SumF32Node>();
+                for (size_t j = 0; j < fanIn; ++j)
+                    sum.values.appendNew().setInput(*previous[rng() % previous.size()]);
+                layer.push_back(&sum.result);
+            }
+            previous.swap(layer);
+        }
+        for (F32BenchSocket* socket : previous)
+            graph.sinks.push_back(&socket->node());
+    }
+
+    double elapsedMs(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    long residentKb() {
+        long pages = 0;
+        FILE* file = fopen("/proc/self/statm", "r");
+        if (!file) return 0;
+        if (fscanf(file, "%*s %ld", &pages) != 1) pages = 0;
+        fclose(file);
+        return pages * (sysconf(_SC_PAGESIZE) / 1024);
+    }
+
+    // The high-water mark of the whole process, so run every generator in its own, see isolated.
+    long peakResidentKb() {
+        rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_maxrss;
+    }
+
+    // Writes the object body writes, from a forked child, so its peakKb is not the peak of an earlier generator.
+    // Falls back to running it in this process when forking fails.
+    void isolated(JsonWriter& writer, const std::function<void(JsonWriter&)>& body) {
+        int fds[2];
+        if (pipe(fds) != 0) {
+            body(writer);
+            return;
+        }
+        std::cout.flush();
+        pid_t pid = fork();
+        if (pid < 0) {
+            close(fds[0]);
+            close(fds[1]);
+            body(writer);
+            return;
+        }
+        if (pid == 0) {
+            close(fds[0]);
+            std::ostringstream out;
+            JsonWriter child(out);
+            body(child);
+            std::string json = out.str();
+            for (size_t written = 0; written < json.size();) {
+                ssize_t count = write(fds[1], json.data() + written, json.size() - written);
+                if (count <= 0) _exit(1);
+                written += (size_t)count;
+            }
+            close(fds[1]);
+            _exit(0);
+        }
+        close(fds[1]);
+        std::string json;
+        char buffer[4096];
+        for (ssize_t count; (count = read(fds[0], buffer, sizeof(buffer))) != 0;) {
+            if (count < 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+            json.append(buffer, (size_t)count);
+        }
+        close(fds[0]);
+        int status = 0;
+        waitpid(pid, &status, 0);
+        if (WIFEXITED(status) && WEXITSTATUS(status) == 0 && !json.empty()) {
+            writer.raw(json);
+            return;
+        }
+        writer.beginObject();
+        writer.key("error");
+        writer.value("The benchmark process failed.");
+        writer.endObject();
+    }
+
+    void run(JsonWriter& writer, const std::string& name, const Generator& generate, size_t size, size_t iterations, unsigned seed) {
+        std::mt19937 rng(seed);
+        writer.beginObject();
+        writer.key("generator");
+        writer.value(name);
+
+        long residentBefore = residentKb();
+        auto start = std::chrono::steady_clock::now();
+        std::unique_ptr<BenchGraph> graph(new BenchGraph);
+        generate(*graph, size, rng);
+        double constructMs = elapsedMs(start);
+        long residentAfter = residentKb();
+
+        writer.key("nodes");
+        writer.value((long long)graph->nodes.size());
+        writer.key("sinks");
+        writer.value((long long)graph->sinks.size());
+        writer.key("constructMs");
+        writer.value(constructMs);
+        writer.key("graphKb");
+        writer.value((long long)(residentAfter - residentBefore));
+
+        start = std::chrono::steady_clock::now();
+        GraphSchedule schedule;
+        schedule.compile(graph->nodes);
+        writer.key("compileMs");
+        writer.value(elapsedMs(start));
+
+        start = std::chrono::steady_clock::now();
+        schedule.evaluate(graph->sinks);
+        writer.key("fullPullMs");
+        writer.value(elapsedMs(start));
+
+        // Time dirtying and recomputing separately, the random root makes sure a cone of varying size is touched.
+        double dirtyMs = 0.0;
+        double pullMs = 0.0;
+        for (size_t i = 0; i < iterations; ++i) {
+            ValueF32Node& root = *graph->roots[rng() % graph->roots.size()];
+            start = std::chrono::steady_clock::now();
+            root.value.setValue((float)(i % 7));
+            dirtyMs += elapsedMs(start);
+            start = std::chrono::steady_clock::now();
+            schedule.evaluate(graph->sinks);
+            pullMs += elapsedMs(start);
+        }
+        writer.key("dirtyUs");
+        writer.value(dirtyMs * 1000.0 / (double)iterations);
+        writer.key("incrementalPullUs");
+        writer.value(pullMs * 1000.0 / (double)iterations);
+
+        // The same with the nodes attached to a DenseGraph, so dirtiness propagates over its flat arrays instead of the sockets.
+        {
+            start = std::chrono::steady_clock::now();
+            DenseGraph dense;
+            dense.build(graph->nodes);
+            writer.key("denseBuildMs");
+            writer.value(elapsedMs(start));
+            dirtyMs = 0.0;
+            pullMs = 0.0;
+            for (size_t i = 0; i < iterations; ++i) {
+                ValueF32Node& root = *graph->roots[rng() % graph->roots.size()];
+                start = std::chrono::steady_clock::now();
+                root.value.setValue((float)(i % 5));
+                dirtyMs += elapsedMs(start);
+                start = std::chrono::steady_clock::now();
+                schedule.evaluate(graph->sinks);
+                pullMs += elapsedMs(start);
+            }
+            writer.key("denseDirtyUs");
+            writer.value(dirtyMs * 1000.0 / (double)iterations);
+            writer.key("denseIncrementalPullUs");
+            writer.value(pullMs * 1000.0 / (double)iterations);
+        }
+
+        GraphSerializer serializer;
+        std::ostringstream json;
+        start = std::chrono::steady_clock::now();
+        serializer.serialize(graph->nodes, json);
+        writer.key("serializeJsonMs");
+        writer.value(elapsedMs(start));
+        writer.key("jsonBytes");
+        writer.value((long long)json.str().size());
+
+        start = std::chrono::steady_clock::now();
+        std::vector<char> binary = serializer.serializeBinary(graph->nodes);
+        writer.key("serializeBinaryMs");
+        writer.value(elapsedMs(start));
+        writer.key("binaryBytes");
+        writer.value((long long)binary.size());
+
+        {
+            GraphArena arena;
+            GraphSerializer deserializer;
+            deserializer.arena = &arena;
+            std::istringstream in(json.str());
+            start = std::chrono::steady_clock::now();
+            std::vector<Node*> loaded = deserializer.deserializeGraph(in);
+            writer.key("deserializeJsonMs");
+            writer.value(elapsedMs(start));
+            writer.key("deserializeJsonErrors");
+            writer.value((long long)deserializer.deserializeErrors.size());
+        }
+
+        {
+            GraphArena arena;
+            GraphSerializer deserializer;
+            deserializer.arena = &arena;
+            start = std::chrono::steady_clock::now();
+            BinaryGraph view;
+            std::vector<Node*> loaded;
+            if (view.open(binary.data(), binary.size()))
+                loaded = deserializer.deserializeGraph(view);
+            else
+                deserializer.deserializeErrors.push_back("Not a binary graph.");
+            writer.key("deserializeBinaryMs");
+            writer.value(elapsedMs(start));
+            writer.key("deserializeBinaryErrors");
+            writer.value((long long)deserializer.deserializeErrors.size());
+        }
+
+        writer.key("peakKb");
+        writer.value((long long)peakResidentKb());
+        writer.endObject();
+    }
+
+    // One integration per hardware thread, summed, next to a chain of cheap nodes that does not depend on them.
+    // Evaluated with the work inline, launched by evaluate so it overlaps with the chain, and by evaluateParallel sharing its pool.
+    void runAsync(JsonWriter& writer, size_t size, size_t iterations) {
+        writer.beginObject();
+        writer.key("generator");
+        writer.value("async");
+
+        BenchGraph graph;
+        size_t count = std::max<size_t>(2, std::thread::hardware_concurrency());
+        SumF32Node& sum = graph.create<SumF32Node>();
+        for (size_t i = 0; i < count; ++i) {
+            ValueF32Node& root = graph.create<ValueF32Node>();
+            graph.roots.push_back(&root);
+            IntegrateF32Node& integrate = graph.create<IntegrateF32Node>();
+            integrate.value.setInput(root.result);
+            sum.values.appendNew().setInput(integrate.result);
+        }
+        graph.sinks.push_back(&sum);
+        ValueF32Node& chainRoot = graph.create<ValueF32Node>();
+        F32BenchSocket* previous = &chainRoot.result;
+        for (size_t i = 1; i < size; ++i) {
+            AddF32Node& node = graph.create<AddF32Node>();
+            node.lhs.setInput(*previous);
+            previous = &node.result;
+        }
+        graph.sinks.push_back(&previous->node());
+
+        writer.key("nodes");
+        writer.value((long long)graph.nodes.size());
+        writer.key("asyncNodes");
+        writer.value((long long)count);
+
+        GraphSchedule schedule;
+        schedule.compile(graph.nodes);
+        ThreadPool pool;
+        // The work is heavy, a few rounds are plenty.
+        iterations = std::min<size_t>(iterations, 20);
+        float value = 1.0f;
+        auto measure = [&](ThreadPool* asyncPool, bool parallel) {
+            AsyncNode::setThreadPool(asyncPool);
+            double ms = 0.0;
+            for (size_t i = 0; i < iterations; ++i) {
+                value += 1.0f;
+                for (ValueF32Node* root : graph.roots)
+                    root->value.setValue(value);
+                chainRoot.value.setValue(value);
+                auto start = std::chrono::steady_clock::now();
+                if (parallel)
+                    schedule.evaluateParallel(graph.sinks, pool);
+                else
+                    schedule.evaluate(graph.sinks);
+                ms += elapsedMs(start);
+            }
+            AsyncNode::setThreadPool(nullptr);
+            return ms / (double)iterations;
+        };
+        writer.key("inlineMs");
+        writer.value(measure(nullptr, false));
+        writer.key("overlappedMs");
+        writer.value(measure(&pool, false));
+        writer.key("parallelMs");
+        writer.value(measure(&pool, true));
+        writer.endObject();
+    }
+}
+
+int main(int argc, char** argv) {
+    size_t size = 100000;
+    size_t iterations = 1000;
+    unsigned seed = 1;
+    std::vector<std::string> selected;
+    for (int i = 1; i < argc; ++i) {
+        if (i + 1 < argc && strcmp(argv[i], "--size") == 0)
+            size = (size_t)strtoull(argv[++i], nullptr, 10);
+        else if (i + 1 < argc && strcmp(argv[i], "--iterations") == 0)
+            iterations = (size_t)strtoull(argv[++i], nullptr, 10);
+        else if (i + 1 < argc && strcmp(argv[i], "--seed") == 0)
+            seed = (unsigned)strtoul(argv[++i], nullptr, 10);
+        else
+            selected.push_back(argv[i]);
+    }
+    size = std::max<size_t>(size, 4);
+    iterations = std::max<size_t>(iterations, 1);
+
+    const std::vector<std::pair<std::string, Generator>> generators = {
+        { "chain", generateChain },
+        { "fan", generateFan },
+        { "diamond", generateDiamond },
+        { "random", generateRandom },
+        { "arrays", generateArrays },
+    };
+
+    JsonWriter writer(std::cout);
+    writer.beginObject();
+    writer.key("size");
+    writer.value((long long)size);
+    writer.key("iterations");
+    writer.value((long long)iterations);
+    writer.key("seed");
+    writer.value((long long)seed);
+    writer.key("results");
+    writer.beginArray();
+    for (const auto& generator : generators) {
+        if (!selected.empty() && std::find(selected.begin(), selected.end(), generator.first) == selected.end())
+            continue;
+        isolated(writer, [&](JsonWriter& result) { run(result, generator.first, generator.second, size, iterations, seed); });
+    }
+    if (selected.empty() || std::find(selected.begin(), selected.end(), "async") != selected.end())
+        isolated(writer, [&](JsonWriter& result) { runAsync(result, size, iterations); });
+    writer.endArray();
+    writer.endObject();
+    std::cout << std::endl;
+    return 0;
+}
@@ -0,0 +1,136 @@
+// Evaluates a pipeline graph against RecordingRenderGraphContext, so it runs without a window or GPU,
+// and prints the time it took and every resource the pipeline would have created as json.
+//
+// Usage: pipeline_stats [--width N] [--height N] [--alias] [--cull] [--shader-cache] [pipeline.json]
+// With --alias, transient images share memory where possible (see TransientImagePlanner).
+// With --cull, only what the passes drawing to the window depend on is evaluated (see RenderPassScheduler::cull).
+// With --shader-cache, shader files are read on a thread pool before evaluating, and files with equal contents are fetched as one stage (see ShaderSourceCache).
+// Relative shader paths are resolved against the working directory.
+
+#include "../rendering_nodes.h"
+#include "../rendering_aliasing.h"
+#include "../rendering_passes.h"
+#include "../dg_io.h"
+#include "../dg_json_stream.h"
+#include "../dg_schedule.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+int main(int argc, char** argv) {
+    unsigned int width = 1920;
+    unsigned int height = 1080;
+    bool alias = false;
+    bool cull = false;
+    bool shaderCache = false;
+    std::string path = "testGraph.json";
+    for (int i = 1; i < argc; ++i) {
+        if (i + 1 < argc && strcmp(argv[i], "--width") == 0)
+            width = (unsigned int)strtoul(argv[++i], nullptr, 10);
+        else if (i + 1 < argc && strcmp(argv[i], "--height") == 0)
+            height = (unsigned int)strtoul(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "--alias") == 0)
+            alias = true;
+        else if (strcmp(argv[i], "--cull") == 0)
+            cull = true;
+        else if (strcmp(argv[i], "--shader-cache") == 0)
+            shaderCache = true;
+        else
+            path = argv[i];
+    }
+
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << "Could not open " << path << std::endl;
+        return 1;
+    }
+
+    RecordingRenderGraphContext context(width, height);
+    TTRendering::MeshHandle quadMesh = TTRendering::MeshHandle::Null;
+    RenderGraphGlobals::gContext = &context;
+    RenderGraphGlobals::gQuadMesh = &quadMesh;
+
+    GraphArena arena;
+    GraphSerializer serializer;
+    serializer.arena = &arena;
+    auto start = std::chrono::steady_clock::now();
+    std::vector<Node*> nodes = serializer.deserializeGraph(in);
+    double loadMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    for (const std::string& error : serializer.deserializeErrors)
+        std::cerr << error << std::endl;
+
+    start = std::chrono::steady_clock::now();
+    ThreadPool ioPool(4);
+    ShaderSourceCache shaderSources(ioPool);
+    if (shaderCache) {
+        RenderGraphGlobals::gShaderSources = &shaderSources;
+        shaderSources.request(nodes);
+    }
+    size_t aliasedImages = 0;
+    std::vector<Node*> sinks;
+    if (alias || cull) {
+        TransientImagePlanner planner;
+        if (cull)
+            planner.plan(nodes, RenderPassScheduler::presentedPasses(nodes));
+        else
+            planner.plan(nodes);
+        if (alias)
+            aliasedImages = planner.apply();
+        if (cull)
+            sinks = planner.scheduler().sinks();
+    }
+    size_t nodeCount = 0;
+    for (Node* node : nodes) {
+        if (!node) continue;
+        nodeCount++;
+        // Without culling every node is a sink, so nothing is skipped for not being connected to the output.
+        if (!cull)
+            sinks.push_back(node);
+    }
+    GraphSchedule schedule;
+    schedule.compile(nodes);
+    schedule.evaluate(sinks);
+    double evaluateMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    RenderPassScheduler passScheduler;
+    passScheduler.schedule(nodes);
+    double scheduleMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    JsonWriter writer(std::cout);
+    writer.beginObject();
+    writer.key("pipeline");
+    writer.value(path);
+    writer.key("nodes");
+    writer.value((long long)nodeCount);
+    writer.key("errors");
+    writer.value((long long)serializer.deserializeErrors.size());
+    writer.key("loadMs");
+    writer.value(loadMs);
+    writer.key("evaluateMs");
+    writer.value(evaluateMs);
+    writer.key("scheduleMs");
+    writer.value(scheduleMs);
+    writer.key("passes");
+    writer.value((long long)passScheduler.passes().size());
+    writer.key("hazards");
+    writer.value((long long)passScheduler.hazards().size());
+    writer.key("aliasedImages");
+    writer.value((long long)aliasedImages);
+    if (shaderCache) {
+        writer.key("shaderFiles");
+        writer.value((long long)shaderSources.pathCount());
+        writer.key("uniqueShaderContents");
+        writer.value((long long)shaderSources.uniqueContentCount());
+        writer.key("shaderBytes");
+        writer.value((long long)shaderSources.byteCount());
+    }
+    writer.key("resources");
+    context.writeReport(writer);
+    writer.endObject();
+    std::cout << std::endl;
+    return serializer.deserializeErrors.empty() && context.unknownReleases() == 0 ? 0 : 1;
+}
@@ -1,16 +1,75 @@
 #include "dg.h"
+#include "dg_dense.h"
+#include "dg_json_stream.h"
+#include "dg_memo.h"
+#include "dg_profile.h"
+
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <unordered_set>
+
+std::atomic<uint64_t> ISocket::sRevision { 0 };
+std::atomic<uint64_t> Node::sNextOrder { 0 };
+std::atomic<uint64_t> Node::sTopologyRevision { 0 };
 
 ISocket::ISocket(const std::string& label, bool isOutput, Node& node) 
-    : _label(label), _isOutput(isOutput), _node(node) {}
+    : _label(SymbolTable::intern(label)), _isOutput(isOutput), _node(node), _changedAt(++sRevision) {}
+
+ISocket::ISocket(Symbol label, bool isOutput, Node& node) 
+    : _label(label), _isOutput(isOutput), _node(node), _changedAt(++sRevision) {}
+
+std::string ISocket::label() const {
+    if (_element == sNotElement)
+        return SymbolTable::name(_label);
+    return SymbolTable::name(_label) + "[" + std::to_string(_element) + "]";
+}
 
 void ISocket::_dirtyNode() const { 
     _node.dirty(*this); 
 }
 
 void ISocket::_computeNode() const { 
+    // Outputs that do not depend on anything that changed since the last compute are still up to date.
+    if (!_isOutputDirty()) return;
     _node.compute(); 
 }
 
+bool ISocket::_isOutputDirty() const {
+    return _denseOutput != sNoDenseOutput ? DenseGraph::test(_node._dense->_outputDirtyBits, _denseOutput) : _outputDirty;
+}
+
+void ISocket::_setOutputDirty(bool dirty) {
+    if (_denseOutput != sNoDenseOutput) DenseGraph::set(_node._dense->_outputDirtyBits, _denseOutput, dirty);
+    else _outputDirty = dirty;
+}
+
+void ISocket::_connectionChanged(const ISocket& other) const {
+    _node._socketsChanged();
+    other._node._socketsChanged();
+}
+
+bool ISocket::_canConnect(const ISocket& input) const {
+    // Reading another input of the same node is fine, reading one of its own outputs is a cycle.
+    if (&input._node == &_node)
+        return !input.isOutput();
+    return Node::_orderBefore(input._node, _node);
+}
+
+bool ISocket::_appendValueKey(std::string& key) const {
+    TTJson::Value value = serializeValue();
+    if (value.isNull())
+        return false;
+    std::ostringstream out;
+    JsonWriter writer(out);
+    writer.value(value);
+    std::string str = out.str();
+    size_t size = str.size();
+    key.append((const char*)&size, sizeof(size));
+    key += str;
+    return true;
+}
+
 bool ISocketArray::deserializeValue(const TTJson::Value& value) {
     if (!value.isArray())
         return false;
@@ -20,6 +79,12 @@ bool ISocketArray::deserializeValue(const TTJson::Value& value) {
     return ok;
 }
 
+ISocketArray::~ISocketArray() {
+    if (node().arena()) return;
+    for (ISocket* child : _children)
+        delete child;
+}
+
 TTJson::Value ISocketArray::serializeValue() const { 
     TTJson::Array result;
     for(const auto& element : _children)
@@ -28,35 +93,316 @@ TTJson::Value ISocketArray::serializeValue() const {
 }
 
 Node::Node(const std::string& label) 
-    : _label(label) {}
+    : _label(label), _arena(GraphArena::current()), _order(++sNextOrder) {}
+
+Node::~Node() {
+    if (_dense)
+        _dense->detachNode(_denseIndex);
+
+    // Sockets in an arena are destroyed along with it.
+    if (_arena) return;
+    for (ISocket* socket : _inputs)
+        delete socket;
+    for (ISocket* socket : _outputs)
+        delete socket;
+}
+
+bool Node::_isDirty() const { 
+    return _dense ? DenseGraph::test(_dense->_dirtyBits, _denseIndex) : _dirty; 
+}
+
+void Node::_setDirty(bool dirty) {
+    if (_dense) DenseGraph::set(_dense->_dirtyBits, _denseIndex, dirty);
+    else _dirty = dirty;
+}
+
+bool Node::_isComputing() const { 
+    return _dense ? DenseGraph::test(_dense->_computingBits, _denseIndex) : _computing; 
+}
+
+void Node::_setComputing(bool computing) {
+    if (_dense) DenseGraph::set(_dense->_computingBits, _denseIndex, computing);
+    else _computing = computing;
+}
+
+void Node::_socketsChanged() {
+    ++sTopologyRevision;
+    if (_arena) ++_arena->_topologyRevision;
+    if (_dense) _dense->invalidate();
+}
+
+Symbol Node::_internSocketLabel(const std::string& label) {
+    // Sockets added after construction, e.g. while loading, are not the same for every node of the type.
+    if (!_initializing)
+        return SymbolTable::intern(label);
+
+    // Constructors add the same sockets in the same order for every node of their type, so remember the labels by position.
+    // Per thread, so this does not lock, and consecutive sockets are usually added by the same constructor.
+    thread_local std::unordered_map<std::type_index, std::vector<Symbol>> types;
+    thread_local const std::type_info* lastType = nullptr;
+    thread_local std::vector<Symbol>* labels = nullptr;
+    const std::type_info& type = typeid(*this);
+    if (&type != lastType) {
+        labels = &types[type];
+        lastType = &type;
+    }
+    size_t position = _inputs.size() + _outputs.size();
+    if (position < labels->size() && SymbolTable::name((*labels)[position]) == label)
+        return (*labels)[position];
+    Symbol symbol = SymbolTable::intern(label);
+    if (position >= labels->size())
+        labels->resize(position + 1, 0);
+    (*labels)[position] = symbol;
+    return symbol;
+}
+
+const SocketSlots* Node::_socketSlots() const {
+    if (_slots) return _slots;
+
+    // The table for a type is built from the first node of that type we are asked about that still has only the sockets
+    // its constructor added. Nodes that had sockets added can not tell which those were, so they wait for another node.
+    static std::mutex mutex;
+    static std::unordered_map<std::type_index, std::unique_ptr<SocketSlots>> tables;
+    std::lock_guard<std::mutex> lock(mutex);
+    auto& table = tables[typeid(*this)];
+    if (!table) {
+        if (_hasExtraSockets)
+            return nullptr;
+        table.reset(new SocketSlots);
+        for (uint32_t i = 0; i < (uint32_t)_inputs.size(); ++i)
+            table->inputs.emplace(_inputs[i]->labelId(), i);
+        for (uint32_t i = 0; i < (uint32_t)_outputs.size(); ++i)
+            table->outputs.emplace(_outputs[i]->labelId(), i);
+    }
+    _slots = table.get();
+    return _slots;
+}
+
+ISocket* Node::findSocket(Symbol label, bool isOutput) const {
+    const auto& sockets = isOutput ? _outputs : _inputs;
+    if (const SocketSlots* table = _socketSlots()) {
+        const auto& slots = isOutput ? table->outputs : table->inputs;
+        auto it = slots.find(label);
+        if (it != slots.end()) {
+            if (it->second < sockets.size() && sockets[it->second]->labelId() == label)
+                return sockets[it->second];
+        } else if (!_hasExtraSockets) {
+            return nullptr;
+        }
+    }
+
+    // This node does not match the shared table, e.g. because sockets were added while loading.
+    for (ISocket* socket : sockets)
+        if (socket->labelId() == label)
+            return socket;
+    return nullptr;
+}
+
+namespace {
+    // Calls fn for the node of every socket that reads from one of the given sockets.
+    template<typename Fn> void forEachDownstream(const std::vector<ISocket*>& sockets, Fn fn) {
+        for (const ISocket* socket : sockets)
+            for (ISocket* other : socket->outputs())
+                fn(other->node());
+    }
+}
+
+bool Node::_orderBefore(Node& upstream, Node& downstream) {
+    // Incremental topological ordering after Pearce & Kelly: a connection that agrees with the current order
+    // needs no work. Otherwise only the nodes with an order between the two endpoints can be affected.
+    uint64_t lower = downstream._order;
+    uint64_t upper = upstream._order;
+    if (lower > upper)
+        return true;
+
+    thread_local std::vector<Node*> forward;
+    thread_local std::vector<Node*> backward;
+    thread_local std::vector<Node*> stack;
+    thread_local std::vector<uint64_t> orders;
+    thread_local std::unordered_set<const Node*> visited;
+    forward.clear();
+    backward.clear();
+    visited.clear();
+
+    // Everything reachable from downstream that currently sorts before upstream. Finding upstream itself means a cycle.
+    stack.assign(1, &downstream);
+    visited.insert(&downstream);
+    while (!stack.empty()) {
+        Node* node = stack.back();
+        stack.pop_back();
+        forward.push_back(node);
+        auto visit = [&](Node& other) {
+            if (&other == &upstream) {
+                visited.insert(&other);
+                return;
+            }
+            if (other._order < upper && visited.insert(&other).second)
+                stack.push_back(&other);
+        };
+        forEachDownstream(node->_inputs, visit);
+        forEachDownstream(node->_outputs, visit);
+    }
+    if (visited.count(&upstream)) {
+        stack.clear();
+        return false;
+    }
+
+    // Everything upstream reaches that currently sorts after downstream.
+    stack.assign(1, &upstream);
+    visited.insert(&upstream);
+    while (!stack.empty()) {
+        Node* node = stack.back();
+        stack.pop_back();
+        backward.push_back(node);
+        auto visit = [&](const ISocket* socket) {
+            const ISocket* input = socket->_getInput();
+            if (input && input->_node._order > lower && visited.insert(&input->_node).second)
+                stack.push_back(&input->_node);
+        };
+        for (const auto* sockets : { &node->_inputs, &node->_outputs }) {
+            for (const ISocket* socket : *sockets) {
+                if (!socket->isArray()) {
+                    visit(socket);
+                    continue;
+                }
+                for (const ISocket* child : ((const ISocketArray*)socket)->_children)
+                    visit(child);
+            }
+        }
+    }
+
+    // Hand out the same order values again, with the upstream side of the new connection first.
+    auto byOrder = [](const Node* a, const Node* b) { return a->_order < b->_order; };
+    std::sort(forward.begin(), forward.end(), byOrder);
+    std::sort(backward.begin(), backward.end(), byOrder);
+    orders.clear();
+    for (const Node* node : backward)
+        orders.push_back(node->_order);
+    for (const Node* node : forward)
+        orders.push_back(node->_order);
+    std::sort(orders.begin(), orders.end());
+    size_t next = 0;
+    for (Node* node : backward)
+        node->_order = orders[next++];
+    for (Node* node : forward)
+        node->_order = orders[next++];
+    return true;
+}
+
+bool Node::_inputsChanged() {
+    for (const ISocket* socket : _inputs) {
+        size_t count = socket->isArray() ? ((const ISocketArray*)socket)->_children.size() : 1;
+        if (socket->_changedAt > _computedAt)
+            return true;
+        for (size_t i = 0; i < count; ++i) {
+            // Follow the connection, bringing upstream outputs up to date so we see whether they really changed.
+            // Like value(), this leaves outputs that are still clean alone, even if their node is dirty for another output.
+            const ISocket* input = socket->isArray() ? ((const ISocketArray*)socket)->_children[i] : socket;
+            while (input) {
+                if (input->isOutput())
+                    input->_computeNode();
+                if (input->_changedAt > _computedAt)
+                    return true;
+                input = input->_getInput();
+            }
+        }
+    }
+    return false;
+}
 
 void Node::compute() {
     TT::assert(!_initializing);
-    if (!_dirty) return;
-    _dirty = false;
-    _computing = true;
-    _compute();
-    _computing = false;
+    if (!_isDirty()) return;
+    _setDirty(false);
+    for (ISocket* output : _outputs)
+        output->_setOutputDirty(false);
+
+    // Opened before checking the inputs, as that is where the upstream computes get pulled.
+    TT_DG_PROFILE_COMPUTE(*this);
+
+    // Dirtiness is pushed downstream before anything recomputes, so it only means something upstream may have changed.
+    // If all inputs turned out to hold the same values as last time (see Socket::sEarlyCutoff), there is nothing to do.
+    if (_computedAt && !_inputsChanged()) {
+        TT_DG_PROFILE_SKIPPED();
+        return;
+    }
+
+    _setComputing(true);
+    if (_memo && cacheable())
+        _memo->compute(*this);
+    else
+        _compute();
+    _setComputing(false);
+    _computedAt = ISocket::sRevision;
+}
+
+void Node::_declareDependencies(const ISocket& output, std::initializer_list<const ISocket*> inputs) {
+    TT::assert(&output.node() == this && output.isOutput());
+    ISocket& socket = const_cast<ISocket&>(output);
+    socket._dependencies = 0;
+    for (const ISocket* input : inputs) {
+        TT::assert(&input->node() == this && !input->isOutput());
+        socket._dependencies |= input->_slotBit();
+    }
+}
+
+void Node::setMemoCache(MemoCache* cache) {
+    _memo = cache;
+    // Our outputs no longer refer to cache entries.
+    for (ISocket* socket : _outputs)
+        socket->_memoId = 0;
 }
 
 void Node::dirty(const ISocket& changed) {
-    // Make sure we are not writing to the wrong type of socket from the wrong place.
-    TT::assert(!_initializing);
-    if (_computing) {
-        TT::assert(changed.isOutput());
+    changed._changedAt = ++ISocket::sRevision;
+    _propagateDirty(changed);
+}
+
+void Node::_propagateDirty(const ISocket& changed) {
+    // Outputs set while computing stop right away, those may be on any thread, so only rebuild for other changes.
+    DenseGraph* dense = _dense;
+    if (dense && dense->isStale() && !_isComputing())
+        dense->_rebuildIfWorthwhile();
+    if (dense && !dense->isStale()) {
+        dense->dirty(changed);
         return;
     }
-    TT::assert(!changed.isOutput());
 
-    // We can watch for specific socket changes to e.g. (re-)generate sockets based on input values.
-    _socketChanged(changed);
-    if (_dirty)
-        return;
+    // Walk the downstream sockets with an explicit worklist instead of recursing, so long chains can not overflow the stack.
+    // The worklist is reused between calls so the steady state does not allocate. A _socketChanged callback may
+    // dirty things again while we are still walking, so every call only processes what it pushed itself.
+    thread_local std::vector<const ISocket*> worklist;
+    size_t base = worklist.size();
+    worklist.push_back(&changed);
+
+    while (worklist.size() > base) {
+        const ISocket& socket = *worklist.back();
+        worklist.pop_back();
+        Node& node = socket.node();
 
-    _dirty = true;
+        // Make sure we are not writing to the wrong type of socket from the wrong place.
+        TT::assert(!node._initializing);
+        if (node._isComputing()) {
+            TT::assert(socket.isOutput());
+            continue;
+        }
+        TT::assert(!socket.isOutput());
 
-    // Dirty dependents
-    for(const auto& output : _outputs)
-        for(auto& other : output->outputs())
-            other->node().dirty(*other);
+        // We can watch for specific socket changes to e.g. (re-)generate sockets based on input values.
+        if (node._watchesSockets)
+            node._socketChanged(socket);
+        node._setDirty(true);
+        TT_DG_PROFILE_DIRTY(node, socket);
+        if (dense)
+            dense->_fallbackWork++;
+
+        // Dirty dependents, but only of the outputs that depend on this input and were not dirty already
+        for (ISocket* output : node._outputs) {
+            if (output->_isOutputDirty() || !output->_dependsOn(socket))
+                continue;
+            output->_setOutputDirty(true);
+            for (ISocket* other : output->outputs())
+                worklist.push_back(other);
+        }
+    }
 }
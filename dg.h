@@ -2,39 +2,143 @@
 
 #include <string>
 #include <vector>
-#include <set>
+#include <algorithm>
 
 #include "../tt_cpplib/tt_json5.h"
 #include "../tt_cpplib/tt_messages.h"
 
+#include "dg_arena.h"
+#include "dg_symbols.h"
+
+#include <atomic>
+#include <cstdint>
+#include <initializer_list>
+#include <memory>
+#include <type_traits>
+#include <typeindex>
+#include <unordered_map>
+
 class Node;
+class DenseGraph;
+class MemoCache;
 
 class ISocket {
 private:
-    std::string _label;
+    Symbol _label;
+    // For elements of arrays, the position in the array, whose label they share. sNotElement otherwise.
+    uint32_t _element = sNotElement;
     bool _isOutput;
     Node& _node;
+    // Index into the DenseGraph the node is attached to, if any.
+    uint32_t _denseIndex = 0;
+    // Revision at which this socket last changed value or connection, see Node::compute.
+    mutable uint64_t _changedAt;
+    // For outputs of nodes computed through a MemoCache, identifies the cached value. 0 otherwise.
+    uint64_t _memoId = 0;
+    // For inputs, the position in the node's inputs. Elements of an array share the slot of their array.
+    uint32_t _slot = 0;
+    // For outputs, one bit per input slot this output depends on, see Node::_declareDependencies. Slots from 63 on share the last bit.
+    uint64_t _dependencies = ~0ull;
+    // For outputs, whether the value may be out of date. Cleared by Node::compute, but never on array elements,
+    // so those always defer to the node's dirty flag. While attached to a DenseGraph this lives there instead, use the accessors below.
+    bool _outputDirty = true;
+    // For outputs of a node attached to a DenseGraph, the index of the output there. Elements of arrays do not get one.
+    uint32_t _denseOutput = sNoDenseOutput;
+
+    uint64_t _slotBit() const { return 1ull << (_slot < 63 ? _slot : 63); }
+    bool _dependsOn(const ISocket& input) const { return (_dependencies & input._slotBit()) != 0; }
+    bool _isOutputDirty() const;
+    void _setOutputDirty(bool dirty);
+
+    static constexpr uint32_t sNoDenseOutput = ~0u;
+    static constexpr uint32_t sNotElement = ~0u;
+
+    static std::atomic<uint64_t> sRevision;
 
     friend class GraphSerializer;
+    friend class GraphSchedule;
+    friend class DenseGraph;
     friend class ISocketArray;
+    friend class Node;
+    friend class MemoCache;
+    template<typename SocketT> friend class SocketArray;
     virtual bool isArray() const = 0; 
 
 protected:
+    // The sockets that have this socket as their input. Array sockets keep this empty and defer to their children.
+    std::vector<ISocket*> _outputs {};
+
     virtual bool deserializeValue(const TTJson::Value& value) { return false; }
     virtual TTJson::Value serializeValue() const { return TTJson::Value(); }
     virtual ISocket* _getInput() const { return nullptr; }
-    virtual void _setInput(ISocket& input) {};
+    // Returns false if the connection was refused, see Socket::setInput.
+    virtual bool _setInput(ISocket& input) { return false; };
+    // Used by MemoCache: appends bytes that identify the current value, returns false if the value can not be identified.
+    // The default goes through serializeValue, so sockets that do not serialize can not be keyed.
+    virtual bool _appendValueKey(std::string& key) const;
+    // Used by MemoCache: copies the value out, and back in with setValue. Returns nullptr if not supported.
+    virtual std::shared_ptr<void> _saveValue() const { return nullptr; }
+    virtual void _loadValue(const std::shared_ptr<void>& value) {}
     virtual std::string typeName() const = 0;
 
     void _dirtyNode() const;
     void _computeNode() const;
+    void _connectionChanged(const ISocket& other) const;
+    void _disconnectOutput(ISocket& output) { _outputs.erase(std::find(_outputs.begin(), _outputs.end(), &output)); }
+    bool _canConnect(const ISocket& input) const;
 
 public:
     ISocket(const std::string& label, bool isOutput, Node& node);
-    const std::string& label() const { return _label; }
+    // For labels that are interned already, see Node::_internSocketLabel.
+    ISocket(Symbol label, bool isOutput, Node& node);
+    virtual ~ISocket() = default;
+    // Elements of arrays are labelled after their array, e.g. values[2].
+    std::string label() const;
+    // Elements of arrays share the label of their array.
+    Symbol labelId() const { return _label; }
     bool isOutput() const { return _isOutput; }
     Node& node() const { return _node; }
-    virtual std::set<ISocket*> outputs() const = 0;
+
+    // Iterates the sockets connected to this one (or to any of its children, for arrays) in place, without allocating.
+    class OutputIterator {
+    private:
+        const ISocket* _socket;
+        bool _array;
+        size_t _child;
+        size_t _connection;
+
+        const ISocket& leaf() const;
+        size_t leafCount() const;
+        void settle() {
+            while (_child < leafCount() && _connection >= leaf()._outputs.size()) {
+                ++_child;
+                _connection = 0;
+            }
+        }
+
+    public:
+        OutputIterator(const ISocket& socket, bool end) 
+            : _socket(&socket), _array(socket.isArray()), _child(0), _connection(0) {
+            if (end) _child = leafCount();
+            else settle();
+        }
+        ISocket* operator*() const { return leaf()._outputs[_connection]; }
+        OutputIterator& operator++() { ++_connection; settle(); return *this; }
+        bool operator==(const OutputIterator& rhs) const { return _child == rhs._child && _connection == rhs._connection; }
+        bool operator!=(const OutputIterator& rhs) const { return !(*this == rhs); }
+    };
+
+    class OutputRange {
+    private:
+        const ISocket& _socket;
+
+    public:
+        OutputRange(const ISocket& socket) : _socket(socket) {}
+        OutputIterator begin() const { return OutputIterator(_socket, false); }
+        OutputIterator end() const { return OutputIterator(_socket, true); }
+    };
+
+    OutputRange outputs() const { return OutputRange(*this); }
 
     ISocket(const ISocket& rhs) = delete;
     ISocket(ISocket&& rhs) = delete;
@@ -45,18 +149,32 @@ public:
 template<typename T, typename CRTP, const char* NAME> class Socket : public ISocket {
 private:
     Socket<T, CRTP, NAME>* _input = nullptr;
-    std::set<ISocket*> _outputs {};
     ISocket* _getInput() const override { return _input; };
-    void _setInput(ISocket& input) override { setInput(*(CRTP*)&input); }
+    bool _setInput(ISocket& input) override { return setInput(*(CRTP*)&input); }
+
+    bool _appendValueKey(std::string& key) const override {
+        if constexpr (std::is_trivially_copyable_v<T>) {
+            key.append((const char*)&_value, sizeof(T));
+            return true;
+        }
+        return ISocket::_appendValueKey(key);
+    }
+    std::shared_ptr<void> _saveValue() const override { return std::make_shared<T>(_value); }
+    void _loadValue(const std::shared_ptr<void>& value) override { setValue(*(const T*)value.get()); }
 
 protected:
     T _value;
 
 public:
     typedef T value_t;
+    // Socket types can opt in to early cutoff by setting this to true in the CRTP class, which requires T to have operator==.
+    // Setting an equal value is then ignored, so neither the node nor anything downstream of it has to recompute.
+    static constexpr bool sEarlyCutoff = false;
 
     Socket(const std::string& label, const T& initialValue, bool isOutput, Node& node) 
         : _value(initialValue), ISocket(label, isOutput, node) {}
+    Socket(Symbol label, const T& initialValue, bool isOutput, Node& node) 
+        : _value(initialValue), ISocket(label, isOutput, node) {}
 
     T& value() {
         if(_input)
@@ -65,26 +183,37 @@ public:
             _computeNode();
         return _value; 
     }
-    const CRTP* input() const { return _input; }
-    std::set<ISocket*> outputs() const override { return _outputs; }
+    const CRTP* input() const { return (const CRTP*)_input; }
 
     void setValue(const T& value) { 
+        if constexpr (CRTP::sEarlyCutoff) {
+            if (_value == value)
+                return;
+        }
         _value = value; 
         if (!_input)
             _dirtyNode();
     }
 
-    void setInput(CRTP& input) {
-        if (_input == (Socket<T, CRTP, NAME>*)&input) return; 
-        if (_input) _input->_outputs.erase(this);
+    // Returns false, leaving the socket as it was, if the connection would create a cycle.
+    bool setInput(CRTP& input) {
+        if (_input == (Socket<T, CRTP, NAME>*)&input) return true; 
+        if (!_canConnect(input)) return false;
+        if (_input) {
+            _input->_disconnectOutput(*this);
+            _connectionChanged(*_input);
+        }
         _input = (Socket<T, CRTP, NAME>*)&input; 
-        _input->_outputs.insert(this);
+        _input->_outputs.push_back(this);
+        _connectionChanged(*_input);
         _dirtyNode();
+        return true;
     }
 
     void disconnect() {
         if (!_input) return; 
-        if (_input) _input->_outputs.erase(this);
+        if (_input) _input->_disconnectOutput(*this);
+        _connectionChanged(*_input);
         _input = nullptr;
         _dirtyNode();
     }
@@ -99,12 +228,23 @@ class ISocketArray : public ISocket {
 
 protected:
     friend class GraphSerializer;
+    friend class GraphSchedule;
+    friend class DenseGraph;
+    friend class ISocket;
+    friend class Node;
+    friend class MemoCache;
     std::vector<ISocket*> _children {};
     virtual ISocket* _appendNew() = 0;
     bool deserializeValue(const TTJson::Value& value) override;
     TTJson::Value serializeValue() const override;
+
+public:
+    ~ISocketArray();
 };
 
+inline const ISocket& ISocket::OutputIterator::leaf() const { return _array ? *((const ISocketArray*)_socket)->_children[_child] : *_socket; }
+inline size_t ISocket::OutputIterator::leafCount() const { return _array ? ((const ISocketArray*)_socket)->_children.size() : 1; }
+
 template<typename SocketT> class SocketArray : public ISocketArray {
 private:
     typename SocketT::value_t _defaultValue;
@@ -113,82 +253,184 @@ private:
 public:
     SocketArray(const std::string& label, const typename SocketT::value_t& defaultValue, bool isOutput, Node& node) 
         : _defaultValue(defaultValue), ISocketArray(label, isOutput, node) {}
+    SocketArray(Symbol label, const typename SocketT::value_t& defaultValue, bool isOutput, Node& node) 
+        : _defaultValue(defaultValue), ISocketArray(label, isOutput, node) {}
 
     const std::vector<SocketT*>& children() const { return *(const std::vector<SocketT*>*)&_children; }
 
-    std::set<ISocket*> outputs() const override { 
-        std::set<ISocket*> outputs;
-        for (const auto& child : _children) {
-            const auto& childInputs = child->outputs();
-            outputs.insert(childInputs.begin(), childInputs.end());
-        }
-        return outputs;
-    }
-
-    SocketT& appendNew() {
-        std::string subLabel = label() + "[" + std::to_string(_children.size()) + "]";
-        SocketT* socket = new SocketT(subLabel, _defaultValue, isOutput(), node());
-        _children.push_back(socket);
-        return *socket;
-    }
+    SocketT& appendNew();
 
     bool isArray() const override { return true; }
     static std::string sTypeName() { return "SocketArray<" + SocketT::sTypeName() + ">"; }
     std::string typeName() const override { return "SocketArray<" + SocketT::sTypeName() + ">"; }
 };
 
+// Where each socket label sits in a node's inputs and outputs, shared by all nodes of the same type.
+struct SocketSlots {
+    std::unordered_map<Symbol, uint32_t> inputs;
+    std::unordered_map<Symbol, uint32_t> outputs;
+};
+
 class Node {
 private:
+    friend class ISocket;
     friend class GraphSerializer;
+    friend class GraphSchedule;
+    friend class DenseGraph;
+    friend class MemoCache;
+    friend class NodeProfiler;
+    friend class AsyncNode;
     std::string _label;
+    // Set when the node was created by a GraphArena, which then also owns its sockets.
+    GraphArena* _arena;
     std::vector<ISocket*> _inputs {};
     std::vector<ISocket*> _outputs {};
+    // While attached to a DenseGraph these flags live there instead, use the accessors below.
     bool _dirty = true;
     bool _computing = false;
+    DenseGraph* _dense = nullptr;
+    uint32_t _denseIndex = 0;
+    // Cleared by the first call to the default _socketChanged, after which dirty propagation stops calling it.
+    std::atomic<bool> _watchesSockets { true };
+    // Revision of the last compute, 0 if we never computed.
+    uint64_t _computedAt = 0;
+    MemoCache* _memo = nullptr;
+    // Looked up on first use, see findSocket.
+    mutable const SocketSlots* _slots = nullptr;
+    // Set when sockets were added after construction, those may not be in _slots.
+    bool _hasExtraSockets = false;
+    // Position in a topological order of all nodes, kept up to date as connections are made, see order().
+    uint64_t _order;
+
+    static std::atomic<uint64_t> sNextOrder;
+    static std::atomic<uint64_t> sTopologyRevision;
+
+    bool _isDirty() const;
+    void _setDirty(bool dirty);
+    bool _isComputing() const;
+    void _setComputing(bool computing);
+    bool _inputsChanged();
+    void _propagateDirty(const ISocket& changed);
+    void _socketsChanged();
+    const SocketSlots* _socketSlots() const;
+    Symbol _internSocketLabel(const std::string& label);
+
+    // Socket types that can be constructed from an interned label get one, see _internSocketLabel.
+    template<typename SocketT, typename T> SocketT* _createLabelledSocket(const std::string& label, const T& initialValue, bool isOutput) {
+        if constexpr (std::is_constructible_v<SocketT, Symbol, const T&, bool, Node&>)
+            return createSocket<SocketT>(_internSocketLabel(label), initialValue, isOutput, *this);
+        else
+            return createSocket<SocketT>(label, initialValue, isOutput, *this);
+    }
+    static bool _orderBefore(Node& upstream, Node& downstream);
 
     virtual std::string typeName() const = 0;
 
 protected:
     bool _initializing = true;
     virtual void _compute() {}
-    virtual void _socketChanged(const ISocket& socket) {}
+    // Called for every input that gets dirtied. Overrides must not call this one, it tells dirty propagation the node type does not listen.
+    virtual void _socketChanged(const ISocket& socket) { _watchesSockets = false; }
+
+    // Declares that the output only depends on the given inputs, so changing any other input does not dirty it or what it connects to.
+    // Outputs depend on all inputs unless declared otherwise. Call from the constructor, after adding the sockets.
+    void _declareDependencies(const ISocket& output, std::initializer_list<const ISocket*> inputs);
 
 public:
     Node(const std::string& label = "");
+    virtual ~Node();
     const std::string& label() const { return _label; }
+    bool isDirty() const { return _isDirty(); }
+    GraphArena* arena() const { return _arena; }
+    // Nodes that read from another node have a higher order, so sorting by this evaluates upstream first.
+    // The values are only meaningful relative to each other and change when connections are made.
+    uint64_t order() const { return _order; }
+    // Counters that go up whenever a value changes, or a connection is made or broken or a socket added, in any graph.
+    // Anything derived from a graph can compare them to the values it was built at to find out cheaply whether it is still up to date.
+    static uint64_t revision() { return ISocket::sRevision; }
+    static uint64_t topologyRevision() { return sTopologyRevision; }
+
+    // Node types whose outputs depend on nothing but their input values can return true, so a MemoCache can hand
+    // them the outputs of an earlier compute with equal inputs instead of running _compute. Not for nodes that
+    // read global state, or whose outputs must be unique objects, e.g. resources that are written to later on.
+    virtual bool cacheable() const { return false; }
+    // Computes cacheable nodes through the given cache, which must outlive this node's use of it. Pass nullptr to stop.
+    void setMemoCache(MemoCache* cache);
+
+    // Finds a socket by its interned label in constant time, for the sockets the node type creates in its constructor.
+    ISocket* findSocket(Symbol label, bool isOutput) const;
+
+    // Allocates a socket for this node, next to the node if it lives in an arena.
+    template<typename SocketT, typename... Args> SocketT* createSocket(Args&&... args) {
+        _socketsChanged();
+        if (_arena)
+            return &_arena->create<SocketT>(std::forward<Args>(args)...);
+        return new SocketT(std::forward<Args>(args)...);
+    }
 
     template<typename SocketT> SocketT& addInput(const std::string& label, const typename SocketT::value_t& initialValue) {
-        SocketT* socket = new SocketT(label, initialValue, false, *this);
+        SocketT* socket = _createLabelledSocket<SocketT>(label, initialValue, false);
+        socket->_slot = (uint32_t)_inputs.size();
         _inputs.push_back(socket);
-        if (!_initializing)
+        if (!_initializing) {
+            _hasExtraSockets = true;
             dirty(*socket);
+        }
         return *socket;
     }
 
     template<typename SocketT> SocketArray<SocketT>& addArrayInput(const std::string& label, const typename SocketT::value_t& initialValue) {
-        SocketArray<SocketT>* socket = new SocketArray<SocketT>(label, initialValue, false, *this);
+        SocketArray<SocketT>* socket = _createLabelledSocket<SocketArray<SocketT>>(label, initialValue, false);
+        socket->_slot = (uint32_t)_inputs.size();
         _inputs.push_back(socket);
-        if (!_initializing)
+        if (!_initializing) {
+            _hasExtraSockets = true;
             dirty(*socket);
+        }
         return *socket;
     }
 
     template<typename T> T& addOutput(const std::string& label, const typename T::value_t& initialValue) {
-        T* socket = new T(label, initialValue, true, *this);
+        T* socket = _createLabelledSocket<T>(label, initialValue, true);
         _outputs.push_back(socket);
-        if (!_initializing)
+        if (!_initializing) {
+            _hasExtraSockets = true;
             dirty(*socket);
+        }
         return *socket;
     }
 
-    template<typename SocketT> SocketT& addArrayOutput(const std::string& label, const typename SocketT::value_t& initialValue) {
-        SocketArray<SocketT>* socket = new SocketArray<SocketT>(label, initialValue, true, *this);
+    template<typename SocketT> SocketArray<SocketT>& addArrayOutput(const std::string& label, const typename SocketT::value_t& initialValue) {
+        SocketArray<SocketT>* socket = _createLabelledSocket<SocketArray<SocketT>>(label, initialValue, true);
         _outputs.push_back(socket);
-        if (!_initializing)
+        if (!_initializing) {
+            _hasExtraSockets = true;
             dirty(*socket);
+        }
         return *socket;
     }
 
     void compute();
     void dirty(const ISocket& changed);
+
+    // Parallel evaluation runs nodes on worker threads, unless they are bound to the thread that owns the graph (e.g. because they use a GL context).
+    virtual bool computeOnOwningThread() const { return false; }
+    // Nodes that compute in the background (see AsyncNode) start doing so here, and return true while they are busy.
+    // GraphSchedule calls this before compute, so it can go on with nodes that do not depend on the result in the meantime.
+    virtual bool launch() { return false; }
 };
+
+template<typename SocketT> SocketT& SocketArray<SocketT>::appendNew() {
+    // Elements share our label and only add their index, so appending does not intern anything.
+    SocketT* socket;
+    if constexpr (std::is_constructible_v<SocketT, Symbol, const typename SocketT::value_t&, bool, Node&>) {
+        socket = node().template createSocket<SocketT>(labelId(), _defaultValue, isOutput(), node());
+        socket->_element = (uint32_t)_children.size();
+    } else {
+        std::string subLabel = label() + "[" + std::to_string(_children.size()) + "]";
+        socket = node().template createSocket<SocketT>(subLabel, _defaultValue, isOutput(), node());
+    }
+    socket->_slot = _slot;
+    _children.push_back(socket);
+    return *socket;
+}
@@ -0,0 +1,32 @@
+#include "dg_arena.h"
+
+thread_local GraphArena* GraphArena::tCurrent = nullptr;
+
+GraphArena::GraphArena(size_t blockSize)
+    : _blockSize(blockSize) {}
+
+void* GraphArena::allocate(size_t size, size_t alignment) {
+    if (!_blocks.empty()) {
+        Block& block = _blocks.back();
+        size_t offset = (block.used + alignment - 1) & ~(alignment - 1);
+        if (offset + size <= block.size) {
+            block.used = offset + size;
+            return block.memory.get() + offset;
+        }
+    }
+
+    // Oversized objects get a block of their own.
+    size_t blockSize = size + alignment > _blockSize ? size + alignment : _blockSize;
+    _blocks.push_back({ std::unique_ptr<char[]>(new char[blockSize]), blockSize, 0 });
+    Block& block = _blocks.back();
+    size_t offset = (alignment - (size_t)block.memory.get() % alignment) % alignment;
+    block.used = offset + size;
+    return block.memory.get() + offset;
+}
+
+void GraphArena::clear() {
+    for (auto it = _destructors.rbegin(); it != _destructors.rend(); ++it)
+        it->destroy(it->object);
+    _destructors.clear();
+    _blocks.clear();
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+// Owns the nodes and sockets of a graph.
+// Objects are bump-allocated into large blocks, so a node and the sockets it adds in its constructor end up next to each other in memory,
+// and everything is destroyed in one go (in reverse creation order) when the arena is cleared or destroyed.
+// Nodes created through an arena pick it up in their constructor and allocate their sockets from it as well.
+class GraphArena {
+private:
+    struct Block {
+        std::unique_ptr<char[]> memory;
+        size_t size;
+        size_t used;
+    };
+
+    struct Destructor {
+        void* object;
+        void (*destroy)(void* object);
+    };
+
+    std::vector<Block> _blocks;
+    std::vector<Destructor> _destructors;
+    size_t _blockSize;
+    // Bumped by Node::_socketsChanged, see topologyRevision.
+    std::atomic<uint64_t> _topologyRevision { 0 };
+    friend class Node;
+
+    void* allocate(size_t size, size_t alignment);
+
+    // The arena that is currently constructing an object on this thread, so a Node constructor can find it.
+    static thread_local GraphArena* tCurrent;
+
+public:
+    explicit GraphArena(size_t blockSize = 64 * 1024);
+    ~GraphArena() { clear(); }
+
+    // Not movable: every node keeps a pointer to the arena it was created in, to allocate the sockets it adds later.
+    GraphArena(GraphArena&& rhs) = delete;
+    GraphArena& operator=(GraphArena&& rhs) = delete;
+    GraphArena(const GraphArena& rhs) = delete;
+    GraphArena& operator=(const GraphArena& rhs) = delete;
+
+    template<typename T, typename... Args> T& create(Args&&... args) {
+        void* memory = allocate(sizeof(T), alignof(T));
+        GraphArena* previous = tCurrent;
+        tCurrent = this;
+        T* object = new(memory) T(std::forward<Args>(args)...);
+        tCurrent = previous;
+        _destructors.push_back({ object, [](void* object) { ((T*)object)->~T(); } });
+        return *object;
+    }
+
+    // Destroys all objects and releases all memory.
+    void clear();
+
+    static GraphArena* current() { return tCurrent; }
+    // Like Node::topologyRevision, but only counting the nodes in this arena, so edits to other graphs do not show up.
+    uint64_t topologyRevision() const { return _topologyRevision; }
+};
@@ -0,0 +1,58 @@
+#include "dg_async.h"
+
+ThreadPool* AsyncNode::sPool = nullptr;
+
+AsyncNode::~AsyncNode() {
+    _cancel();
+}
+
+bool AsyncNode::launch() {
+    if (_job) return true;
+    if (!_isDirty() || _isComputing()) return false;
+    // Same check as compute makes, there is no point in starting work it is going to skip.
+    if (_computedAt && !_inputsChanged()) return false;
+    return _run();
+}
+
+bool AsyncNode::_run() {
+    Work work = _start();
+    std::shared_ptr<Job> job = std::make_shared<Job>();
+    _job = job;
+    if (!sPool) {
+        job->finish = work(*job);
+        job->finished = true;
+        return false;
+    }
+    sPool->submit([job, work]() {
+        // Cancelled work may still be queued, skip it if it did not start yet.
+        Finish finish = job->cancelled() ? Finish() : work(*job);
+        std::lock_guard<std::mutex> lock(job->mutex);
+        job->finish = std::move(finish);
+        job->finished = true;
+        job->done.notify_all();
+    });
+    return true;
+}
+
+void AsyncNode::_compute() {
+    // Pulled without being launched first, or launched work was cancelled: start now, and wait right away.
+    if (!_job)
+        _run();
+    std::shared_ptr<Job> job = std::move(_job);
+    {
+        std::unique_lock<std::mutex> lock(job->mutex);
+        job->done.wait(lock, [&job]() { return job->finished; });
+    }
+    if (job->finish)
+        job->finish();
+}
+
+void AsyncNode::_cancel() {
+    if (!_job) return;
+    _job->_cancelled = true;
+    _job.reset();
+}
+
+void AsyncNode::_socketChanged(const ISocket& socket) {
+    _cancel();
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "dg.h"
+#include "dg_threadpool.h"
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+// A node that does its work (file I/O, heavy number crunching) on a ThreadPool instead of inside the pull that needs it.
+// launch() reads the inputs and hands the work to the pool; the outputs are only waited for when somebody pulls them,
+// so GraphSchedule::evaluate can run everything that does not depend on them in the meantime.
+// If an input is dirtied while the work is running, the work is cancelled and started over on the next launch or pull.
+class AsyncNode : public Node {
+public:
+    // Passed to the work, which should give up early once cancelled() is true. Its result is ignored either way.
+    class Cancellation {
+    private:
+        std::atomic<bool> _cancelled { false };
+        friend class AsyncNode;
+
+    public:
+        bool cancelled() const { return _cancelled; }
+    };
+
+    // Writes the result of the work to the outputs, runs on the thread that pulls them.
+    typedef std::function<void()> Finish;
+    // Runs on the pool. Must not touch sockets or the node, everything it needs is captured by value.
+    typedef std::function<Finish(const Cancellation&)> Work;
+
+private:
+    struct Job : Cancellation {
+        std::mutex mutex;
+        std::condition_variable done;
+        bool finished = false;
+        Finish finish;
+    };
+
+    std::shared_ptr<Job> _job;
+
+    static ThreadPool* sPool;
+
+    bool _run();
+    void _cancel();
+    void _compute() final;
+
+protected:
+    // Runs where the node computes: read the inputs and return the work.
+    virtual Work _start() = 0;
+    // Cancels running work. Node types that watch their own inputs must call this from their override.
+    void _socketChanged(const ISocket& socket) override;
+
+public:
+    using Node::Node;
+    ~AsyncNode();
+
+    bool launch() override;
+    // Whether work was launched and has not been picked up by a compute yet.
+    bool isRunning() const { return _job != nullptr; }
+
+    // The pool all async nodes run their work on. Without one the work runs inline, as part of launch.
+    static void setThreadPool(ThreadPool* pool) { sPool = pool; }
+    static ThreadPool* threadPool() { return sPool; }
+};
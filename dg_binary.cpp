@@ -0,0 +1,467 @@
+#include "dg_binary.h"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    const char sMagic[4] = { 'T', 'T', 'D', 'G' };
+
+    size_t align4(size_t size) { return (size + 3) & ~(size_t)3; }
+
+    template<typename T> void append(std::vector<char>& dst, const T* src, size_t count) {
+        const char* begin = (const char*)src;
+        dst.insert(dst.end(), begin, begin + sizeof(T) * count);
+    }
+
+    template<typename T> void appendRaw(std::vector<uint8_t>& dst, const T& value) {
+        const uint8_t* begin = (const uint8_t*)&value;
+        dst.insert(dst.end(), begin, begin + sizeof(T));
+    }
+
+    template<typename T> bool readRaw(const uint8_t* src, size_t size, uint32_t& offset, T& value) {
+        if (offset + sizeof(T) > size) return false;
+        memcpy(&value, src + offset, sizeof(T));
+        offset += sizeof(T);
+        return true;
+    }
+}
+
+/// Reading
+bool BinaryGraph::open(const char* data, size_t size) {
+    // Everything is validated on locals first, so a failed open leaves the view as it was.
+    if (size < sizeof(BinaryGraphHeader) || (size_t)data % 4 != 0)
+        return false;
+    const BinaryGraphHeader* header = (const BinaryGraphHeader*)data;
+    if (memcmp(header->magic, sMagic, 4) != 0 || header->version != sVersion)
+        return false;
+
+    size_t cursor = sizeof(BinaryGraphHeader);
+    auto section = [&](size_t bytes) -> const char* {
+        const char* result = data + cursor;
+        cursor += align4(bytes);
+        return result;
+    };
+    // Check the total size before handing out any pointers.
+    size_t required = sizeof(BinaryGraphHeader)
+        + align4(sizeof(uint32_t) * ((size_t)header->stringCount + 1))
+        + align4(header->charCount)
+        + align4(sizeof(BinaryGraphNode) * (size_t)header->nodeCount)
+        + align4(sizeof(BinaryGraphSocket) * (size_t)header->socketCount)
+        + align4(sizeof(BinaryGraphConnection) * (size_t)header->connectionCount)
+        + align4(sizeof(uint32_t) * (size_t)header->arrayIndexCount)
+        + header->valueBytes;
+    if (size < required)
+        return false;
+
+    const uint32_t* stringOffsets = (const uint32_t*)section(sizeof(uint32_t) * ((size_t)header->stringCount + 1));
+    const char* chars = section(header->charCount);
+    const BinaryGraphNode* nodes = (const BinaryGraphNode*)section(sizeof(BinaryGraphNode) * header->nodeCount);
+    const BinaryGraphSocket* sockets = (const BinaryGraphSocket*)section(sizeof(BinaryGraphSocket) * header->socketCount);
+    const BinaryGraphConnection* connections = (const BinaryGraphConnection*)section(sizeof(BinaryGraphConnection) * header->connectionCount);
+    const uint32_t* arrayIndices = (const uint32_t*)section(sizeof(uint32_t) * header->arrayIndexCount);
+    const uint8_t* values = (const uint8_t*)section(header->valueBytes);
+
+    // Validate all indices up front, so the accessors do not have to.
+    for (uint32_t i = 0; i < header->stringCount; ++i)
+        if (stringOffsets[i] > stringOffsets[i + 1] || stringOffsets[i + 1] > header->charCount)
+            return false;
+    for (uint32_t i = 0; i < header->nodeCount; ++i) {
+        const auto& node = nodes[i];
+        if (node.type >= header->stringCount || node.label >= header->stringCount ||
+            (uint64_t)node.firstSocket + node.inputCount + node.outputCount > header->socketCount)
+            return false;
+    }
+    for (uint32_t i = 0; i < header->socketCount; ++i) {
+        const auto& socket = sockets[i];
+        if (socket.type >= header->stringCount || socket.label >= header->stringCount || socket.value >= header->valueBytes)
+            return false;
+    }
+    for (uint32_t i = 0; i < header->connectionCount; ++i) {
+        for (const auto* path : { &connections[i].source, &connections[i].destination }) {
+            if (path->node >= header->nodeCount ||
+                (uint64_t)path->slot >= (uint64_t)nodes[path->node].inputCount + nodes[path->node].outputCount ||
+                (uint64_t)path->firstArrayIndex + path->arrayIndexCount > header->arrayIndexCount)
+                return false;
+        }
+    }
+
+    _data = data;
+    _size = size;
+    _header = header;
+    _stringOffsets = stringOffsets;
+    _chars = chars;
+    _nodes = nodes;
+    _sockets = sockets;
+    _connections = connections;
+    _arrayIndices = arrayIndices;
+    _values = values;
+    return true;
+}
+
+TTJson::Value BinaryGraph::value(uint32_t& offset, bool& ok, uint32_t depth) const {
+    uint8_t tag;
+    if (!readRaw(_values, _header->valueBytes, offset, tag)) {
+        ok = false;
+        return TTJson::Value();
+    }
+    switch ((BinaryGraphValueTag)tag) {
+    case BinaryGraphValueTag::Int: {
+        long long i = 0;
+        ok &= readRaw(_values, _header->valueBytes, offset, i);
+        return i;
+    }
+    case BinaryGraphValueTag::Double: {
+        double d = 0.0;
+        ok &= readRaw(_values, _header->valueBytes, offset, d);
+        return d;
+    }
+    case BinaryGraphValueTag::String: {
+        uint32_t index = 0;
+        if (!readRaw(_values, _header->valueBytes, offset, index) || index >= _header->stringCount) {
+            ok = false;
+            return TTJson::Value();
+        }
+        return (TTJson::str_t)std::string(string(index));
+    }
+    case BinaryGraphValueTag::Array: {
+        uint32_t count = 0;
+        ok &= readRaw(_values, _header->valueBytes, offset, count);
+        if (depth >= sMaxValueDepth) {
+            ok = false;
+            return TTJson::Value();
+        }
+        TTJson::Array result;
+        for (uint32_t i = 0; i < count && ok; ++i)
+            result.push_back(value(offset, ok, depth + 1));
+        return result;
+    }
+    case BinaryGraphValueTag::Null:
+        return TTJson::Value();
+    }
+    ok = false;
+    return TTJson::Value();
+}
+
+bool BinaryGraph::value(uint32_t offset, TTJson::Value& result) const {
+    bool ok = true;
+    result = value(offset, ok, 0);
+    return ok;
+}
+
+/// Writing
+uint32_t BinaryGraphBuilder::string(const std::string& str) {
+    const auto& it = _stringIds.find(str);
+    if (it != _stringIds.end())
+        return it->second;
+    uint32_t id = (uint32_t)_strings.size();
+    _strings.push_back(str);
+    _stringIds[str] = id;
+    return id;
+}
+
+void BinaryGraphBuilder::writeValue(const TTJson::Value& value) {
+    if (value.isInt()) {
+        _values.push_back((uint8_t)BinaryGraphValueTag::Int);
+        appendRaw(_values, (long long)value.asInt());
+    } else if (value.isDouble()) {
+        _values.push_back((uint8_t)BinaryGraphValueTag::Double);
+        appendRaw(_values, (double)value.asDouble());
+    } else if (value.isString()) {
+        _values.push_back((uint8_t)BinaryGraphValueTag::String);
+        appendRaw(_values, string(value.asString()));
+    } else if (value.isArray()) {
+        const auto& array = value.asArray();
+        _values.push_back((uint8_t)BinaryGraphValueTag::Array);
+        appendRaw(_values, (uint32_t)array.size());
+        for (const auto& element : array)
+            writeValue(element);
+    } else {
+        // Sockets do not serialize objects, anything else we do not know about is stored as null.
+        _values.push_back((uint8_t)BinaryGraphValueTag::Null);
+    }
+}
+
+void BinaryGraphBuilder::addNode(const std::string& type, const std::string& label) {
+    _nodes.push_back({ string(type), string(label), (uint32_t)_sockets.size(), 0, 0 });
+}
+
+void BinaryGraphBuilder::addSocket(const std::string& type, const std::string& label, const TTJson::Value& value, bool isOutput) {
+    TT::assert(!_nodes.empty());
+    BinaryGraphNode& node = _nodes.back();
+    if (isOutput) {
+        ++node.outputCount;
+    } else {
+        TT::assert(node.outputCount == 0);
+        ++node.inputCount;
+    }
+    _sockets.push_back({ string(type), string(label), (uint32_t)_values.size() });
+    writeValue(value);
+}
+
+void BinaryGraphBuilder::addConnection(uint32_t sourceNode, uint32_t sourceSlot, const std::vector<size_t>& sourceIndices,
+                                       uint32_t destinationNode, uint32_t destinationSlot, const std::vector<size_t>& destinationIndices) {
+    BinaryGraphConnection connection;
+    connection.source = { sourceNode, sourceSlot, (uint32_t)_arrayIndices.size(), (uint32_t)sourceIndices.size() };
+    for (size_t i : sourceIndices)
+        _arrayIndices.push_back((uint32_t)i);
+    connection.destination = { destinationNode, destinationSlot, (uint32_t)_arrayIndices.size(), (uint32_t)destinationIndices.size() };
+    for (size_t i : destinationIndices)
+        _arrayIndices.push_back((uint32_t)i);
+    _connections.push_back(connection);
+}
+
+std::vector<char> BinaryGraphBuilder::finish() const {
+    std::vector<uint32_t> stringOffsets;
+    std::string chars;
+    for (const auto& str : _strings) {
+        stringOffsets.push_back((uint32_t)chars.size());
+        chars += str;
+    }
+    stringOffsets.push_back((uint32_t)chars.size());
+
+    BinaryGraphHeader header;
+    memcpy(header.magic, sMagic, 4);
+    header.version = BinaryGraph::sVersion;
+    header.stringCount = (uint32_t)_strings.size();
+    header.charCount = (uint32_t)chars.size();
+    header.nodeCount = (uint32_t)_nodes.size();
+    header.socketCount = (uint32_t)_sockets.size();
+    header.connectionCount = (uint32_t)_connections.size();
+    header.arrayIndexCount = (uint32_t)_arrayIndices.size();
+    header.valueBytes = (uint32_t)_values.size();
+
+    std::vector<char> result;
+    auto pad = [&]() { result.resize(align4(result.size()), 0); };
+    append(result, &header, 1);
+    append(result, stringOffsets.data(), stringOffsets.size());
+    append(result, chars.data(), chars.size());
+    pad();
+    append(result, _nodes.data(), _nodes.size());
+    append(result, _sockets.data(), _sockets.size());
+    append(result, _connections.data(), _connections.size());
+    append(result, _arrayIndices.data(), _arrayIndices.size());
+    append(result, _values.data(), _values.size());
+    return result;
+}
+
+/// Memory mapping
+bool MappedFile::open(const std::string& path) {
+    close();
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping) {
+        CloseHandle(file);
+        return false;
+    }
+    _data = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!_data) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+    _file = file;
+    _mapping = mapping;
+    _size = (size_t)size.QuadPart;
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+    void* data = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping keeps the file alive.
+    ::close(fd);
+    if (data == MAP_FAILED)
+        return false;
+    _data = (const char*)data;
+    _size = (size_t)info.st_size;
+#endif
+    return true;
+}
+
+void MappedFile::close() {
+    if (!_data) return;
+#ifdef _WIN32
+    UnmapViewOfFile(_data);
+    CloseHandle((HANDLE)_mapping);
+    CloseHandle((HANDLE)_file);
+    _file = nullptr;
+    _mapping = nullptr;
+#else
+    munmap((void*)_data, _size);
+#endif
+    _data = nullptr;
+    _size = 0;
+}
+
+/// Conversion
+namespace {
+    bool jsonSocketPath(const TTJson::Object& pathObj, const std::vector<std::vector<std::string>>& labels, uint32_t& node, uint32_t& slot, std::vector<size_t>& indices, std::vector<std::string>& errors) {
+        auto nodeId = pathObj.tryGetInt("nodeId");
+        auto socketLabel = pathObj.tryGetString("socketLabel");
+        if (!nodeId || !socketLabel) {
+            errors.push_back("Document contains invalid connection. Missing nodeId or socketLabel.");
+            return false;
+        }
+        if (*nodeId < 0 || (size_t)*nodeId >= labels.size()) {
+            errors.push_back("Document contains invalid connection. nodeId is out of bounds for socket: " + *socketLabel);
+            return false;
+        }
+        node = (uint32_t)*nodeId;
+
+        // Note: this assumes socket names are unique, same as GraphSerializer::findSocket.
+        const auto& nodeLabels = labels[node];
+        size_t found = std::find(nodeLabels.begin(), nodeLabels.end(), *socketLabel) - nodeLabels.begin();
+        if (found == nodeLabels.size()) {
+            errors.push_back("Document contains invalid connection. No socket on the node with label: " + *socketLabel);
+            return false;
+        }
+        slot = (uint32_t)found;
+
+        indices.clear();
+        auto socketArrayIndices = pathObj.tryGetArray("socketArrayIndices");
+        if (socketArrayIndices)
+            for (const auto& index : *socketArrayIndices)
+                if (index.isInt())
+                    indices.push_back((size_t)index.asInt());
+        return true;
+    }
+
+    void jsonSocketPath(const BinaryGraph& graph, const BinaryGraphSocketPath& path, TTJson::Object& result) {
+        const auto& node = graph.node(path.node);
+        result["nodeId"] = (long long)path.node;
+        result["socketLabel"] = (TTJson::str_t)std::string(graph.string(graph.socket(node.firstSocket + path.slot).label));
+        TTJson::Array indices;
+        for (uint32_t i = 0; i < path.arrayIndexCount; ++i)
+            indices.push_back((long long)graph.arrayIndex(path.firstArrayIndex + i));
+        result["socketArrayIndices"] = indices;
+    }
+}
+
+bool jsonToBinaryGraph(const TTJson::Value& document, std::vector<char>& result, std::vector<std::string>& errors) {
+    if (!document.isObject()) {
+        errors.push_back("Document root must be an object.");
+        return false;
+    }
+
+    BinaryGraphBuilder builder;
+    // Socket labels per node, in slot order, to resolve connections.
+    std::vector<std::vector<std::string>> labels;
+
+    auto nodeObjs = document.asObject().tryGetArray("nodes");
+    if (nodeObjs) {
+        for (const auto& nodeValue : *nodeObjs) {
+            labels.emplace_back();
+            if (!nodeValue.isObject()) {
+                // Keep the node ids of the other nodes intact.
+                errors.push_back("Document contains invalid nodes entry. Must be an object.");
+                builder.addNode("", "");
+                continue;
+            }
+            const auto& nodeObj = nodeValue.asObject();
+            auto type = nodeObj.tryGetString("type");
+            auto label = nodeObj.tryGetString("label");
+            if (!type)
+                errors.push_back("Document missing type for nodes entry.");
+            builder.addNode(type ? *type : "", label ? *label : "");
+
+            for (bool isOutput : { false, true }) {
+                auto sockets = nodeObj.tryGetArray(isOutput ? "outputs" : "inputs");
+                if (!sockets) continue;
+                for (const auto& socketValue : *sockets) {
+                    if (!socketValue.isObject()) continue;
+                    const auto& socketObj = socketValue.asObject();
+                    auto socketType = socketObj.tryGetString("type");
+                    auto socketLabel = socketObj.tryGetString("label");
+                    if (!socketType || !socketLabel) {
+                        errors.push_back("Document missing type or label entry, or entries are not strings, for socket on node: " + (label ? *label : std::string()));
+                        continue;
+                    }
+                    auto value = socketObj.tryGet("value");
+                    builder.addSocket(*socketType, *socketLabel, value ? *value : TTJson::Value(), isOutput);
+                    labels.back().push_back(*socketLabel);
+                }
+            }
+        }
+    }
+
+    auto connectionObjs = document.asObject().tryGetArray("connections");
+    if (connectionObjs) {
+        uint32_t sourceNode, sourceSlot, destinationNode, destinationSlot;
+        std::vector<size_t> sourceIndices, destinationIndices;
+        for (const auto& connectionValue : *connectionObjs) {
+            if (!connectionValue.isObject()) continue; // malformed json
+            auto sourceObj = connectionValue.asObject().tryGetObject("source");
+            auto destinationObj = connectionValue.asObject().tryGetObject("destination");
+            if (!sourceObj || !destinationObj) continue; // malformed json
+            if (!jsonSocketPath(*sourceObj, labels, sourceNode, sourceSlot, sourceIndices, errors)) continue;
+            if (!jsonSocketPath(*destinationObj, labels, destinationNode, destinationSlot, destinationIndices, errors)) continue;
+            builder.addConnection(sourceNode, sourceSlot, sourceIndices, destinationNode, destinationSlot, destinationIndices);
+        }
+    }
+
+    result = builder.finish();
+    return errors.empty();
+}
+
+TTJson::Object binaryGraphToJson(const BinaryGraph& graph) {
+    TTJson::Object result;
+
+    TTJson::Array outNodes;
+    for (uint32_t i = 0; i < graph.nodeCount(); ++i) {
+        const auto& node = graph.node(i);
+        TTJson::Object nodeObj;
+        nodeObj["type"] = (TTJson::str_t)std::string(graph.string(node.type));
+        nodeObj["label"] = (TTJson::str_t)std::string(graph.string(node.label));
+        TTJson::Array inputs, outputs;
+        for (uint32_t slot = 0; slot < node.inputCount + node.outputCount; ++slot) {
+            const auto& socket = graph.socket(node.firstSocket + slot);
+            TTJson::Object socketObj;
+            socketObj["type"] = (TTJson::str_t)std::string(graph.string(socket.type));
+            socketObj["label"] = (TTJson::str_t)std::string(graph.string(socket.label));
+            TTJson::Value value;
+            graph.value(socket.value, value);
+            socketObj["value"] = value;
+            (slot < node.inputCount ? inputs : outputs).push_back(socketObj);
+        }
+        nodeObj["inputs"] = inputs;
+        nodeObj["outputs"] = outputs;
+        outNodes.push_back(nodeObj);
+    }
+    result["nodes"] = outNodes;
+
+    TTJson::Array outConnections;
+    for (uint32_t i = 0; i < graph.connectionCount(); ++i) {
+        const auto& connection = graph.connection(i);
+        TTJson::Object source, destination;
+        jsonSocketPath(graph, connection.source, source);
+        jsonSocketPath(graph, connection.destination, destination);
+        TTJson::Object outConnection;
+        outConnection["source"] = source;
+        outConnection["destination"] = destination;
+        outConnections.push_back(outConnection);
+    }
+    result["connections"] = outConnections;
+    return result;
+}
@@ -0,0 +1,159 @@
+#pragma once
+
+#include "dg.h"
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+/*
+Compact binary counterpart of the json format in dg_io.h, meant to be memory mapped and read in place.
+All integers are little endian uint32 unless noted otherwise, sections are 4-byte aligned and follow each other in this order:
+
+BinaryGraphHeader
+uint32 stringOffsets[stringCount + 1]    string i is chars[stringOffsets[i]] up to chars[stringOffsets[i + 1]], not null terminated
+char chars[]                             padded to 4 bytes
+BinaryGraphNode nodes[nodeCount]
+BinaryGraphSocket sockets[socketCount]   each node owns sockets[firstSocket] up to sockets[firstSocket + inputCount + outputCount], inputs first
+BinaryGraphConnection connections[connectionCount]
+uint32 arrayIndices[arrayIndexCount]
+uint8 values[valueBytes]                 socket values, see BinaryGraphValueTag
+
+Connections address sockets by integer path: node index, socket slot within that node, and a range of arrayIndices to walk into socket arrays.
+*/
+
+struct BinaryGraphHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t stringCount;
+    uint32_t charCount;
+    uint32_t nodeCount;
+    uint32_t socketCount;
+    uint32_t connectionCount;
+    uint32_t arrayIndexCount;
+    uint32_t valueBytes;
+};
+
+struct BinaryGraphNode {
+    uint32_t type;
+    uint32_t label;
+    uint32_t firstSocket;
+    uint32_t inputCount;
+    uint32_t outputCount;
+};
+
+struct BinaryGraphSocket {
+    uint32_t type;
+    uint32_t label;
+    // Offset into the value section.
+    uint32_t value;
+};
+
+struct BinaryGraphSocketPath {
+    uint32_t node;
+    uint32_t slot;
+    uint32_t firstArrayIndex;
+    uint32_t arrayIndexCount;
+};
+
+struct BinaryGraphConnection {
+    BinaryGraphSocketPath source;
+    BinaryGraphSocketPath destination;
+};
+
+// Values are a tag byte followed by the payload:
+// Int: int64, Double: float64, String: uint32 string index, Array: uint32 count followed by the elements.
+enum class BinaryGraphValueTag : uint8_t { Null, Int, Double, String, Array };
+
+// Read-only view over a binary graph in memory, does not copy anything.
+class BinaryGraph {
+private:
+    const char* _data = nullptr;
+    size_t _size = 0;
+    const BinaryGraphHeader* _header = nullptr;
+    const uint32_t* _stringOffsets = nullptr;
+    const char* _chars = nullptr;
+    const BinaryGraphNode* _nodes = nullptr;
+    const BinaryGraphSocket* _sockets = nullptr;
+    const BinaryGraphConnection* _connections = nullptr;
+    const uint32_t* _arrayIndices = nullptr;
+    const uint8_t* _values = nullptr;
+
+    TTJson::Value value(uint32_t& offset, bool& ok, uint32_t depth) const;
+
+public:
+    static constexpr uint32_t sVersion = 1;
+    // Arrays nested deeper than this are rejected, so a malformed file can not exhaust the stack.
+    static constexpr uint32_t sMaxValueDepth = 64;
+
+    // Validates the header and section sizes, returns false if the data is not a binary graph.
+    // The view only changes when it succeeds.
+    bool open(const char* data, size_t size);
+
+    uint32_t nodeCount() const { return _header->nodeCount; }
+    uint32_t socketCount() const { return _header->socketCount; }
+    uint32_t connectionCount() const { return _header->connectionCount; }
+    const BinaryGraphNode& node(uint32_t index) const { return _nodes[index]; }
+    const BinaryGraphSocket& socket(uint32_t index) const { return _sockets[index]; }
+    const BinaryGraphConnection& connection(uint32_t index) const { return _connections[index]; }
+    uint32_t arrayIndex(uint32_t index) const { return _arrayIndices[index]; }
+    std::string_view string(uint32_t index) const { return std::string_view(_chars + _stringOffsets[index], _stringOffsets[index + 1] - _stringOffsets[index]); }
+
+    // Decodes a socket value, so it can be handed to ISocket::deserializeValue.
+    // Returns false if the value runs out of bounds or nests too deep.
+    bool value(uint32_t offset, TTJson::Value& result) const;
+    bool isNull(uint32_t offset) const { return offset < _header->valueBytes && _values[offset] == (uint8_t)BinaryGraphValueTag::Null; }
+};
+
+// Assembles a binary graph in memory.
+class BinaryGraphBuilder {
+private:
+    std::vector<std::string> _strings;
+    std::unordered_map<std::string, uint32_t> _stringIds;
+    std::vector<BinaryGraphNode> _nodes;
+    std::vector<BinaryGraphSocket> _sockets;
+    std::vector<BinaryGraphConnection> _connections;
+    std::vector<uint32_t> _arrayIndices;
+    std::vector<uint8_t> _values;
+
+    void writeValue(const TTJson::Value& value);
+
+public:
+    uint32_t string(const std::string& str);
+
+    // Sockets must be added right after the node they belong to, inputs first.
+    void addNode(const std::string& type, const std::string& label);
+    void addSocket(const std::string& type, const std::string& label, const TTJson::Value& value, bool isOutput);
+    void addConnection(uint32_t sourceNode, uint32_t sourceSlot, const std::vector<size_t>& sourceIndices,
+                       uint32_t destinationNode, uint32_t destinationSlot, const std::vector<size_t>& destinationIndices);
+
+    std::vector<char> finish() const;
+};
+
+// Maps a file into memory read-only.
+class MappedFile {
+private:
+    const char* _data = nullptr;
+    size_t _size = 0;
+#ifdef _WIN32
+    void* _file = nullptr;
+    void* _mapping = nullptr;
+#endif
+
+public:
+    MappedFile() = default;
+    ~MappedFile() { close(); }
+
+    bool open(const std::string& path);
+    void close();
+    const char* data() const { return _data; }
+    size_t size() const { return _size; }
+
+    MappedFile(const MappedFile& rhs) = delete;
+    MappedFile& operator=(const MappedFile& rhs) = delete;
+};
+
+// Converters between the json document format of GraphSerializer and the binary format, without instantiating any nodes.
+bool jsonToBinaryGraph(const TTJson::Value& document, std::vector<char>& result, std::vector<std::string>& errors);
+TTJson::Object binaryGraphToJson(const BinaryGraph& graph);
@@ -0,0 +1,223 @@
+#include "dg_dense.h"
+#include "dg_profile.h"
+
+#include <algorithm>
+
+void DenseGraph::addSocket(ISocket& socket, uint32_t node) {
+    socket._denseIndex = (uint32_t)_sockets.size();
+    _sockets.push_back(&socket);
+    _socketNode.push_back(node);
+    _socketSlot.push_back(socket.isOutput() ? sOutputSlot : (uint8_t)(socket._slot < 63 ? socket._slot : 63));
+    if (socket.isArray())
+        for (ISocket* element : ((ISocketArray&)socket)._children)
+            addSocket(*element, node);
+}
+
+std::vector<std::atomic<uint64_t>> DenseGraph::makeBits(size_t count) {
+    std::vector<std::atomic<uint64_t>> bits((count + 63) / 64);
+    for (auto& word : bits)
+        word = 0;
+    return bits;
+}
+
+void DenseGraph::build(const std::vector<Node*>& nodes) {
+    detach();
+
+    for (Node* node : nodes) {
+        if (!node || node->_dense == this) continue;
+        TT::assert(node->_dense == nullptr);
+        node->_dense = this;
+        node->_denseIndex = (uint32_t)_nodes.size();
+        _nodes.push_back(node);
+    }
+
+    // Take over the flags
+    _dirtyBits = makeBits(_nodes.size());
+    _computingBits = makeBits(_nodes.size());
+    _watchingBits = makeBits(_nodes.size());
+    for (uint32_t i = 0; i < (uint32_t)_nodes.size(); ++i) {
+        set(_dirtyBits, i, _nodes[i]->_dirty);
+        set(_computingBits, i, _nodes[i]->_computing);
+        set(_watchingBits, i, _nodes[i]->_watchesSockets);
+    }
+
+    // Number the sockets
+    for (uint32_t i = 0; i < (uint32_t)_nodes.size(); ++i) {
+        for (ISocket* socket : _nodes[i]->_inputs)
+            addSocket(*socket, i);
+        for (ISocket* socket : _nodes[i]->_outputs)
+            addSocket(*socket, i);
+    }
+
+    // Flatten the connections
+    std::vector<ISocket*> inputs;
+    for (uint32_t i = 0; i < (uint32_t)_nodes.size(); ++i) {
+        _firstOutput.push_back((uint32_t)_edgeOffsets.size());
+        for (const ISocket* output : _nodes[i]->_outputs) {
+            _edgeOffsets.push_back((uint32_t)_edgeTargets.size());
+            _outputDependencies.push_back(output->_dependencies);
+            for (ISocket* other : output->outputs()) {
+                if (other->node()._dense == this) {
+                    _edgeTargets.push_back(other->_denseIndex);
+                } else {
+                    _edgeTargets.push_back((uint32_t)(_sockets.size() + _externalTargets.size()));
+                    _externalTargets.push_back(other);
+                }
+            }
+        }
+
+        _upstreamOffsets.push_back((uint32_t)_upstream.size());
+        size_t first = _upstream.size();
+        for (ISocket* socket : _nodes[i]->_inputs) {
+            inputs.clear();
+            if (socket->isArray())
+                inputs.insert(inputs.end(), ((ISocketArray*)socket)->_children.begin(), ((ISocketArray*)socket)->_children.end());
+            else
+                inputs.push_back(socket);
+            for (const ISocket* input : inputs) {
+                const ISocket* source = input->_getInput();
+                if (!source || source->node()._dense != this) continue;
+                uint32_t n = source->node()._denseIndex;
+                if (std::find(_upstream.begin() + first, _upstream.end(), n) == _upstream.end())
+                    _upstream.push_back(n);
+            }
+        }
+    }
+    _firstOutput.push_back((uint32_t)_edgeOffsets.size());
+    _edgeOffsets.push_back((uint32_t)_edgeTargets.size());
+    _upstreamOffsets.push_back((uint32_t)_upstream.size());
+
+    // Take over the output flags, from here on the sockets go through ISocket::_isOutputDirty
+    _outputDirtyBits = makeBits(_outputDependencies.size());
+    for (uint32_t i = 0; i < (uint32_t)_nodes.size(); ++i) {
+        uint32_t o = _firstOutput[i];
+        for (ISocket* output : _nodes[i]->_outputs) {
+            set(_outputDirtyBits, o, output->_outputDirty);
+            output->_denseOutput = o++;
+        }
+    }
+    _stale = false;
+    _fallbackWork = 0;
+}
+
+void DenseGraph::rebuild() {
+    std::vector<Node*> nodes;
+    nodes.reserve(_nodes.size());
+    for (Node* node : _nodes)
+        if (node)
+            nodes.push_back(node);
+    build(nodes);
+}
+
+void DenseGraph::_rebuildIfWorthwhile() {
+    // A rebuild touches every socket about once.
+    if (_walking || _fallbackWork < _sockets.size()) return;
+    rebuild();
+}
+
+void DenseGraph::detach() {
+    for (uint32_t i = 0; i < (uint32_t)_nodes.size(); ++i) {
+        Node* node = _nodes[i];
+        if (!node) continue;
+        node->_dirty = test(_dirtyBits, i);
+        node->_computing = test(_computingBits, i);
+        // Outputs added since the build were never numbered and kept their own flag.
+        for (ISocket* output : node->_outputs) {
+            if (output->_denseOutput == ISocket::sNoDenseOutput) continue;
+            output->_outputDirty = test(_outputDirtyBits, output->_denseOutput);
+            output->_denseOutput = ISocket::sNoDenseOutput;
+        }
+        node->_dense = nullptr;
+    }
+    _nodes.clear();
+    _sockets.clear();
+    _socketNode.clear();
+    _socketSlot.clear();
+    _firstOutput.clear();
+    _edgeOffsets.clear();
+    _edgeTargets.clear();
+    _externalTargets.clear();
+    _outputDependencies.clear();
+    _upstreamOffsets.clear();
+    _upstream.clear();
+    _dirtyBits.clear();
+    _computingBits.clear();
+    _outputDirtyBits.clear();
+    _watchingBits.clear();
+    _stale = false;
+    _fallbackWork = 0;
+}
+
+void DenseGraph::detachNode(uint32_t node) {
+    _nodes[node] = nullptr;
+    _stale = true;
+}
+
+size_t DenseGraph::dirtyCount() const {
+    size_t count = 0;
+    for (const auto& word : _dirtyBits) {
+        uint64_t bits = word.load();
+        while (bits) {
+            bits &= bits - 1;
+            ++count;
+        }
+    }
+    return count;
+}
+
+void DenseGraph::dirtyNodes(std::vector<uint32_t>& result) const {
+    for (size_t i = 0; i < _dirtyBits.size(); ++i) {
+        uint64_t bits = _dirtyBits[i].load();
+        for (uint32_t bit = 0; bits; ++bit, bits >>= 1)
+            if (bits & 1)
+                result.push_back((uint32_t)(i * 64 + bit));
+    }
+}
+
+void DenseGraph::dirty(const ISocket& changed) {
+    // Same walk as Node::dirty, over indices.
+    thread_local std::vector<uint32_t> worklist;
+    size_t base = worklist.size();
+    worklist.push_back(changed._denseIndex);
+    _walking++;
+
+    while (worklist.size() > base) {
+        uint32_t s = worklist.back();
+        worklist.pop_back();
+
+        // Connections to sockets outside of this graph continue in their own graph.
+        if (s >= _sockets.size()) {
+            ISocket& external = *_externalTargets[s - _sockets.size()];
+            external.node()._propagateDirty(external);
+            continue;
+        }
+
+        // Everything below reads the arrays, the node and socket are only visited for types that watch their sockets.
+        uint32_t n = _socketNode[s];
+        uint8_t slot = _socketSlot[s];
+        if (test(_computingBits, n)) {
+            TT::assert(slot == sOutputSlot);
+            continue;
+        }
+        TT::assert(slot != sOutputSlot);
+
+        if (test(_watchingBits, n)) {
+            Node& node = *_nodes[n];
+            node._socketChanged(*_sockets[s]);
+            if (!node._watchesSockets)
+                set(_watchingBits, n, false);
+        }
+        set(_dirtyBits, n, true);
+        TT_DG_PROFILE_DIRTY(*_nodes[n], *_sockets[s]);
+
+        uint64_t bit = 1ull << slot;
+        for (uint32_t o = _firstOutput[n]; o < _firstOutput[n + 1]; ++o) {
+            if ((_outputDependencies[o] & bit) == 0 || test(_outputDirtyBits, o))
+                continue;
+            set(_outputDirtyBits, o, true);
+            for (uint32_t e = _edgeOffsets[o]; e < _edgeOffsets[o + 1]; ++e)
+                worklist.push_back(_edgeTargets[e]);
+        }
+    }
+    _walking--;
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "dg.h"
+
+#include <atomic>
+#include <cstdint>
+
+// An index-addressed storage backend for a set of nodes.
+// While nodes are attached, their dirty and computing flags live in bitsets here instead of in the nodes,
+// and dirty propagation walks flat arrays (connections stored as compressed sparse rows) instead of chasing socket pointers.
+// Sockets keep their typed values and API, they just carry an index into these arrays.
+//
+// Making or breaking connections, or adding sockets, marks the graph stale. Propagation then falls back to walking the sockets,
+// while the flags stay where they are, until that has cost about as much as a rebuild: then the arrays are built again.
+// So a burst of edits (like loading a document) does not rebuild on every connection, and the arrays are back once it is over.
+class DenseGraph {
+private:
+    friend class ISocket;
+    friend class Node;
+
+    std::vector<Node*> _nodes;
+    std::vector<ISocket*> _sockets;
+    // The index of the node owning each socket, and the slot of each input (capped as in ISocket::_slotBit) or sOutputSlot for outputs.
+    std::vector<uint32_t> _socketNode;
+    std::vector<uint8_t> _socketSlot;
+    // Output k of node n is output _firstOutput[n] + k. _edgeTargets[_edgeOffsets[o]] up to _edgeTargets[_edgeOffsets[o + 1]]
+    // are the sockets connected to output o (or its elements, for arrays).
+    // Targets of socketCount or more index _externalTargets, for connections leaving this graph.
+    std::vector<uint32_t> _firstOutput;
+    std::vector<uint32_t> _edgeOffsets;
+    std::vector<uint32_t> _edgeTargets;
+    std::vector<ISocket*> _externalTargets;
+    // Per output, the input slots it depends on (see ISocket::_dependencies), so propagation does not need to visit the sockets.
+    std::vector<uint64_t> _outputDependencies;
+    // _upstream[_upstreamOffsets[n]] up to _upstream[_upstreamOffsets[n + 1]] are the nodes in this graph that node n reads from.
+    std::vector<uint32_t> _upstreamOffsets;
+    std::vector<uint32_t> _upstream;
+
+    // One bit per node. Parallel evaluation touches neighbouring bits from different threads, so these are atomic.
+    std::vector<std::atomic<uint64_t>> _dirtyBits;
+    std::vector<std::atomic<uint64_t>> _computingBits;
+    // One bit per output, see ISocket::_outputDirty.
+    std::vector<std::atomic<uint64_t>> _outputDirtyBits;
+    // One bit per node whose type may still want Node::_socketChanged calls.
+    std::vector<std::atomic<uint64_t>> _watchingBits;
+    bool _stale = false;
+    // Sockets walked by the fallback since going stale, and how many dense walks are in progress (a rebuild must wait for those).
+    size_t _fallbackWork = 0;
+    std::atomic<uint32_t> _walking { 0 };
+
+    void addSocket(ISocket& socket, uint32_t node);
+    void _rebuildIfWorthwhile();
+    void detachNode(uint32_t node);
+
+    static constexpr uint8_t sOutputSlot = 0xff;
+
+    static std::vector<std::atomic<uint64_t>> makeBits(size_t count);
+    static bool test(const std::vector<std::atomic<uint64_t>>& bits, uint32_t i) { return (bits[i >> 6].load() >> (i & 63)) & 1; }
+    static void set(std::vector<std::atomic<uint64_t>>& bits, uint32_t i, bool value) {
+        if (value) bits[i >> 6].fetch_or(1ull << (i & 63));
+        else bits[i >> 6].fetch_and(~(1ull << (i & 63)));
+    }
+
+    void dirty(const ISocket& changed);
+
+public:
+    DenseGraph() = default;
+    ~DenseGraph() { detach(); }
+
+    // Attaches the given nodes, moving their flags in here. A node can only be attached to one DenseGraph at a time.
+    void build(const std::vector<Node*>& nodes);
+    // Builds again from the nodes that are still attached, e.g. after connections changed.
+    void rebuild();
+    // Moves the flags back into the nodes.
+    void detach();
+
+    bool isStale() const { return _stale; }
+    void invalidate() { _stale = true; }
+
+    size_t nodeCount() const { return _nodes.size(); }
+    size_t socketCount() const { return _sockets.size(); }
+    size_t edgeCount() const { return _edgeTargets.size(); }
+    Node* node(size_t index) const { return _nodes[index]; }
+
+    bool isDirty(size_t node) const { return test(_dirtyBits, (uint32_t)node); }
+    size_t dirtyCount() const;
+    // Appends the indices of all dirty nodes, found by scanning the bitset a word at a time.
+    void dirtyNodes(std::vector<uint32_t>& result) const;
+
+    const uint32_t* upstreamBegin(size_t node) const { return _upstream.data() + _upstreamOffsets[node]; }
+    const uint32_t* upstreamEnd(size_t node) const { return _upstream.data() + _upstreamOffsets[node + 1]; }
+
+    DenseGraph(const DenseGraph& rhs) = delete;
+    DenseGraph(DenseGraph&& rhs) = delete;
+    DenseGraph& operator=(const DenseGraph& rhs) = delete;
+    DenseGraph& operator=(DenseGraph&& rhs) = delete;
+};
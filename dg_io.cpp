@@ -1,4 +1,5 @@
 #include "dg_io.h"
+#include "dg_json_stream.h"
 
 /// Serialization
 TTJson::Object GraphSerializer::serialize(const std::vector<Node*>& nodes) {
@@ -95,28 +96,29 @@ TTJson::Object GraphSerializer::serialize(const ISocket& socket, const SocketPat
 }
 
 /// Deserialization
-ISocket* GraphSerializer::findSocket(const std::vector<ISocket*>& sockets, const std::string& label, const std::vector<size_t>& indices) {
+ISocket* GraphSerializer::findSocket(const Node& node, const std::string& label, const std::vector<size_t>& indices) {
     // Note: this assumes socket names are unique.
-    for (ISocket* socket : sockets) {
-        if (socket->label() == label) {
-            for (size_t i : indices) {
-                if (!socket->isArray()) {
-                    deserializeErrors.push_back("Document gave array index for connection, but the found socket is not an array. Looking for socket: " + label);
-                    return nullptr;
-                }
-                socket = ((ISocketArray*)socket)->_children[i];
-            }
-            return socket;
+    Symbol symbol;
+    if (!SymbolTable::find(label, symbol))
+        return nullptr;
+    ISocket* socket = node.findSocket(symbol, false);
+    if (!socket)
+        socket = node.findSocket(symbol, true);
+    if (!socket)
+        return nullptr;
+
+    for (size_t i : indices) {
+        if (!socket->isArray()) {
+            deserializeErrors.push_back("Document gave array index for connection, but the found socket is not an array. Looking for socket: " + label);
+            return nullptr;
+        }
+        if (i >= ((ISocketArray*)socket)->_children.size()) {
+            deserializeErrors.push_back("Document gave array index for connection that is out of bounds. Looking for socket: " + label);
+            return nullptr;
         }
+        socket = ((ISocketArray*)socket)->_children[i];
     }
-    return nullptr;
-}
-
-ISocket* GraphSerializer::findSocket(const Node& node, const std::string& label, const std::vector<size_t>& indices) {
-    ISocket* result = findSocket(node._inputs, label, indices);
-    if (result)
-        return result;
-    return findSocket(node._outputs, label, indices);
+    return socket;
 }
 
 // only returns a value if it is a valid socket not already found on the node
@@ -124,34 +126,58 @@ void GraphSerializer::deserializeSocket(const TTJson::Object& socketObj, Node& n
     auto type = socketObj.tryGetString("type");
     auto label = socketObj.tryGetString("label");
 
-    std::string nodeErrStr = node.label() + " (" + node.typeName() + ")";
     if(!label || !type) {
+        std::string nodeErrStr = node.label() + " (" + node.typeName() + ")";
         deserializeErrors.push_back("Document missing type or label entry, or entries are not strings, for socket on node: " + nodeErrStr);
         return;
     }
-    ISocket* into = nullptr;
+    ISocket* into = findOrCreateSocket(node, *type, *label, isOutput);
+    if (!into)
+        return;
 
-    // Note: this assumes socket names are unique.
-    for (ISocket* socket : isOutput ? node._outputs : node._inputs) {
-        if (socket->label() == *label) {
-            into = socket; 
-            break;
-        }
+    auto value = socketObj.tryGet("value");
+    if(value)
+        into->deserializeValue(*value);
+}
+
+Node* GraphSerializer::createNode(const std::string& type, const std::string& label) {
+    Symbol symbol;
+    TypeRegistry::NodeCreateFn create = SymbolTable::find(type, symbol) ? TypeRegistry::findNodeType(symbol) : nullptr;
+    if (create)
+        return create(arena, label);
+
+    const auto& it = nodeFactory.find(type);
+    if (it == nodeFactory.end()) {
+        deserializeErrors.push_back("Document gave unknown node type: " + type);
+        return nullptr;
     }
+    return &it->second(label);
+}
+
+ISocket* GraphSerializer::findOrCreateSocket(Node& node, const std::string& type, const std::string& label, bool isOutput) {
+    // Note: this assumes socket names are unique.
+    ISocket* socket = node.findSocket(SymbolTable::intern(label), isOutput);
+    if (socket)
+        return socket;
 
-    if(!into) {
-        const auto& it = socketFactory.find(*type);
+    ISocket* into = nullptr;
+    Symbol symbol;
+    TypeRegistry::SocketCreateFn create = SymbolTable::find(type, symbol) ? TypeRegistry::findSocketType(symbol) : nullptr;
+    if (create) {
+        into = create(label, isOutput, node);
+    } else {
+        const auto& it = socketFactory.find(type);
         if (it == socketFactory.end()) {
-            deserializeErrors.push_back("Document gave unknown type for node socket: " + nodeErrStr + "." + *label + " (" + *type + ")");
-            return;
+            deserializeErrors.push_back("Document gave unknown type for node socket: " + node.label() + " (" + node.typeName() + ")." + label + " (" + type + ")");
+            return nullptr;
         }
-        into = it->second(*label, isOutput, node);
-        (isOutput ? node._outputs : node._inputs).push_back(into);
+        into = it->second(label, isOutput, node);
     }
-
-    auto value = socketObj.tryGet("value");
-    if(value)
-        into->deserializeValue(*value);
+    if (!isOutput)
+        into->_slot = (uint32_t)node._inputs.size();
+    (isOutput ? node._outputs : node._inputs).push_back(into);
+    node._hasExtraSockets = true;
+    return into;
 }
 
 Node* GraphSerializer::deserializeNode(const TTJson::Object& nodeObj) {
@@ -161,15 +187,13 @@ Node* GraphSerializer::deserializeNode(const TTJson::Object& nodeObj) {
         deserializeErrors.push_back("Document missing type for nodes entry.");
         return nullptr;
     }
-    const auto& it2 = nodeFactory.find(*type);
-    if (it2 == nodeFactory.end()) {
-        deserializeErrors.push_back("Document gave unknown node type: " + *type);
-        return nullptr;
-    }
 
     // spawn
     auto label = nodeObj.tryGetString("label");
-    Node& instance = it2->second(label ? *label : "");
+    Node* spawned = createNode(*type, label ? *label : "");
+    if (!spawned)
+        return nullptr;
+    Node& instance = *spawned;
 
     std::string nodeErrStr = instance.label() + " (" + *type + ")";
 
@@ -219,17 +243,31 @@ ISocket* GraphSerializer::deserializeSocketPath(const TTJson::Object& connection
         }
     }
 
-    if(*nodeId < 0 || (size_t)*nodeId >= nodes.size()) {
+    if(*nodeId < 0) {
         deserializeErrors.push_back("Document contains invalid connection. nodeId is out of bounds for socket: " + *socketLabel);
         return nullptr;
     }
 
-    if(nodes[*nodeId] == nullptr) {
+    return findSocket({ (size_t)*nodeId, *socketLabel, arrayIndices }, nodes);
+}
+
+ISocket* GraphSerializer::findSocket(const SocketPath& path, const std::vector<Node*>& nodes) {
+    if(path.nodeId >= nodes.size()) {
+        deserializeErrors.push_back("Document contains invalid connection. nodeId is out of bounds for socket: " + path.socketLabel);
+        return nullptr;
+    }
+
+    if(nodes[path.nodeId] == nullptr) {
         deserializeErrors.push_back("Failed to connect to node that could not be read. See previous errors for more info.");
         return nullptr;
     }
 
-    return findSocket(*nodes[*nodeId], *socketLabel, arrayIndices);
+    return findSocket(*nodes[path.nodeId], path.socketLabel, path.socketArrayIndices);
+}
+
+void GraphSerializer::connect(ISocket& source, ISocket& destination) {
+    if (!destination._setInput(source))
+        deserializeErrors.push_back("Document contains a cycle. Refused to connect " + source.node().typeName() + "." + source.label() + " to " + destination.node().typeName() + "." + destination.label());
 }
 
 std::vector<Node*> GraphSerializer::deserializeGraph(const TTJson::Value& document) {
@@ -266,8 +304,464 @@ std::vector<Node*> GraphSerializer::deserializeGraph(const TTJson::Value& docume
             if (!sourceObj || !destinationObj) continue; // malformed json
             ISocket* source = deserializeSocketPath(*sourceObj, graph);
             ISocket* destination = deserializeSocketPath(*destinationObj, graph);
-            destination->_setInput(*source);
+            if (!source || !destination) continue; // error already reported
+            connect(*source, *destination);
+        }
+    }
+    return graph;
+}
+
+/// Binary
+std::vector<char> GraphSerializer::serializeBinary(const std::vector<Node*>& nodes) {
+    struct BinaryPath {
+        uint32_t nodeId;
+        uint32_t slot;
+        std::vector<size_t> indices;
+    };
+    std::unordered_map<const ISocket*, BinaryPath> paths;
+    std::vector<std::pair<const ISocket*, const ISocket*>> connections;
+
+    // Register the socket and its array elements, and queue up its input connection.
+    std::function<void(const ISocket&, const BinaryPath&)> visit = [&](const ISocket& socket, const BinaryPath& path) {
+        paths[&socket] = path;
+        if (socket.isArray()) {
+            size_t arrayIndex = 0;
+            for (const ISocket* element : ((const ISocketArray&)socket)._children) {
+                BinaryPath elementPath = path;
+                elementPath.indices.push_back(arrayIndex++);
+                visit(*element, elementPath);
+            }
+        } else if (socket._getInput()) {
+            connections.push_back({ socket._getInput(), &socket });
+        }
+    };
+
+    BinaryGraphBuilder builder;
+    uint32_t nodeId = 0;
+    for (const Node* node : nodes) {
+        builder.addNode(node->typeName(), node->label());
+        uint32_t slot = 0;
+        for (const ISocket* socket : node->_inputs) {
+            builder.addSocket(socket->typeName(), socket->label(), socket->serializeValue(), false);
+            visit(*socket, { nodeId, slot++, {} });
+        }
+        for (const ISocket* socket : node->_outputs) {
+            builder.addSocket(socket->typeName(), socket->label(), socket->serializeValue(), true);
+            visit(*socket, { nodeId, slot++, {} });
+        }
+        ++nodeId;
+    }
+
+    for (const auto& pair : connections) {
+        auto it1 = paths.find(pair.first);
+        auto it2 = paths.find(pair.second);
+        if (it1 == paths.end() || it2 == paths.end())
+            continue;
+        builder.addConnection(it1->second.nodeId, it1->second.slot, it1->second.indices, it2->second.nodeId, it2->second.slot, it2->second.indices);
+    }
+
+    return builder.finish();
+}
+
+ISocket* GraphSerializer::findArrayElement(ISocket* socket, const BinaryGraph& graph, const BinaryGraphSocketPath& path) {
+    for (uint32_t i = 0; i < path.arrayIndexCount && socket; ++i) {
+        uint32_t index = graph.arrayIndex(path.firstArrayIndex + i);
+        if (!socket->isArray() || index >= ((ISocketArray*)socket)->_children.size()) {
+            deserializeErrors.push_back("Document gave array index for connection, but the found socket is not an array or the index is out of bounds. Looking for socket: " + socket->label());
+            return nullptr;
         }
+        socket = ((ISocketArray*)socket)->_children[index];
+    }
+    return socket;
+}
+
+std::vector<Node*> GraphSerializer::deserializeGraph(const BinaryGraph& graph) {
+    std::vector<Node*> result(graph.nodeCount(), nullptr);
+    // Maps every socket in the document to the socket it was loaded into, so connections resolve by index.
+    std::vector<ISocket*> sockets(graph.socketCount(), nullptr);
+
+    TTJson::Value value;
+    for (uint32_t i = 0; i < graph.nodeCount(); ++i) {
+        const auto& nodeEntry = graph.node(i);
+        Node* spawned = createNode(std::string(graph.string(nodeEntry.type)), std::string(graph.string(nodeEntry.label)));
+        if (!spawned)
+            continue;
+        Node& instance = *spawned;
+        result[i] = &instance;
+
+        for (uint32_t slot = 0; slot < nodeEntry.inputCount + nodeEntry.outputCount; ++slot) {
+            const auto& socketEntry = graph.socket(nodeEntry.firstSocket + slot);
+            ISocket* socket = findOrCreateSocket(instance, std::string(graph.string(socketEntry.type)), std::string(graph.string(socketEntry.label)), slot >= nodeEntry.inputCount);
+            if (!socket) continue;
+            sockets[nodeEntry.firstSocket + slot] = socket;
+            if (graph.isNull(socketEntry.value)) continue;
+            if (graph.value(socketEntry.value, value))
+                socket->deserializeValue(value);
+            else
+                deserializeErrors.push_back("Document contains a truncated value for socket: " + socket->label());
+        }
+    }
+
+    for (uint32_t i = 0; i < graph.connectionCount(); ++i) {
+        const auto& connection = graph.connection(i);
+        ISocket* source = sockets[graph.node(connection.source.node).firstSocket + connection.source.slot];
+        ISocket* destination = sockets[graph.node(connection.destination.node).firstSocket + connection.destination.slot];
+        source = findArrayElement(source, graph, connection.source);
+        destination = findArrayElement(destination, graph, connection.destination);
+        if (!source || !destination) {
+            deserializeErrors.push_back("Failed to connect to socket that could not be read. See previous errors for more info.");
+            continue;
+        }
+        connect(*source, *destination);
+    }
+    return result;
+}
+
+/// Streaming
+bool GraphSerializer::findSocketPath(const ISocket& socket, const ISocket& candidate, std::vector<size_t>& indices) {
+    if (&candidate == &socket)
+        return true;
+    if (!candidate.isArray())
+        return false;
+    const auto& children = ((const ISocketArray&)candidate)._children;
+    for (size_t i = 0; i < children.size(); ++i) {
+        indices.push_back(i);
+        if (findSocketPath(socket, *children[i], indices))
+            return true;
+        indices.pop_back();
+    }
+    return false;
+}
+
+void GraphSerializer::write(JsonWriter& writer, const SocketPath& path) {
+    writer.beginObject();
+    writer.key("nodeId");
+    writer.value((long long)path.nodeId);
+    writer.key("socketLabel");
+    writer.value(path.socketLabel);
+    writer.key("socketArrayIndices");
+    writer.beginArray();
+    for (size_t i : path.socketArrayIndices)
+        writer.value((long long)i);
+    writer.endArray();
+    writer.endObject();
+}
+
+void GraphSerializer::write(JsonWriter& writer, const ISocket& socket) {
+    writer.beginObject();
+    writer.key("type");
+    writer.value(socket.typeName());
+    writer.key("label");
+    writer.value(socket.label());
+    writer.key("value");
+    writer.value(socket.serializeValue());
+    writer.endObject();
+}
+
+void GraphSerializer::writeInputConnections(JsonWriter& writer, const ISocket& socket, const SocketPath& path, const std::unordered_map<const Node*, size_t>& nodeIds) {
+    if (socket.isArray()) {
+        size_t arrayIndex = 0;
+        for (const ISocket* element : ((const ISocketArray&)socket)._children) {
+            SocketPath elementPath = path;
+            elementPath.socketArrayIndices.push_back(arrayIndex++);
+            writeInputConnections(writer, *element, elementPath, nodeIds);
+        }
+        return;
+    }
+
+    const ISocket* source = socket._getInput();
+    if (!source)
+        return;
+    // Connections to nodes that are not being saved are dropped, like the non-streaming serialize does.
+    auto it = nodeIds.find(&source->node());
+    if (it == nodeIds.end())
+        return;
+
+    // Look the source up on its node instead of keeping a path for every socket we wrote.
+    SocketPath sourcePath { it->second, "", {} };
+    const Node& sourceNode = source->node();
+    bool found = false;
+    for (const auto* sockets : { &sourceNode._inputs, &sourceNode._outputs }) {
+        for (const ISocket* candidate : *sockets) {
+            if (findSocketPath(*source, *candidate, sourcePath.socketArrayIndices)) {
+                sourcePath.socketLabel = candidate->label();
+                found = true;
+                break;
+            }
+        }
+        if (found) break;
+    }
+    if (!found)
+        return;
+
+    writer.beginObject();
+    writer.key("source");
+    write(writer, sourcePath);
+    writer.key("destination");
+    write(writer, path);
+    writer.endObject();
+}
+
+void GraphSerializer::serialize(const std::vector<Node*>& nodes, std::ostream& out) {
+    std::unordered_map<const Node*, size_t> nodeIds;
+    for (size_t i = 0; i < nodes.size(); ++i)
+        nodeIds[nodes[i]] = i;
+
+    JsonWriter writer(out);
+    writer.beginObject();
+
+    writer.key("nodes");
+    writer.beginArray();
+    for (const Node* node : nodes) {
+        writer.beginObject();
+        writer.key("type");
+        writer.value(node->typeName());
+        writer.key("label");
+        writer.value(node->label());
+        writer.key("inputs");
+        writer.beginArray();
+        for (const ISocket* socket : node->_inputs)
+            write(writer, *socket);
+        writer.endArray();
+        writer.key("outputs");
+        writer.beginArray();
+        for (const ISocket* socket : node->_outputs)
+            write(writer, *socket);
+        writer.endArray();
+        writer.endObject();
+    }
+    writer.endArray();
+
+    // Second pass, so we only need the node ids and not a path for every socket.
+    writer.key("connections");
+    writer.beginArray();
+    for (size_t nodeId = 0; nodeId < nodes.size(); ++nodeId) {
+        for (const ISocket* socket : nodes[nodeId]->_inputs)
+            writeInputConnections(writer, *socket, { nodeId, socket->label(), {} }, nodeIds);
+        for (const ISocket* socket : nodes[nodeId]->_outputs)
+            writeInputConnections(writer, *socket, { nodeId, socket->label(), {} }, nodeIds);
+    }
+    writer.endArray();
+
+    writer.endObject();
+}
+
+bool GraphSerializer::readSocketPath(JsonReader& reader, SocketPath& path) {
+    if (reader.next() != JsonReader::Token::BeginObject)
+        return false;
+    path = { 0, "", {} };
+    bool hasNodeId = false;
+    bool hasLabel = false;
+    while (true) {
+        JsonReader::Token token = reader.next();
+        if (token == JsonReader::Token::EndObject) break;
+        if (token != JsonReader::Token::Key) return false;
+        std::string key = reader.string();
+        token = reader.next();
+        if (key == "nodeId" && token == JsonReader::Token::Int && reader.intValue() >= 0) {
+            path.nodeId = (size_t)reader.intValue();
+            hasNodeId = true;
+        } else if (key == "socketLabel" && token == JsonReader::Token::String) {
+            path.socketLabel = reader.string();
+            hasLabel = true;
+        } else if (key == "socketArrayIndices" && token == JsonReader::Token::BeginArray) {
+            while ((token = reader.next()) != JsonReader::Token::EndArray) {
+                if (token == JsonReader::Token::Int) {
+                    path.socketArrayIndices.push_back((size_t)reader.intValue());
+                    continue;
+                }
+                deserializeErrors.push_back("Document contains invalid connection. socketArrayIndices is not an array of ints for socket: " + path.socketLabel);
+                if (!reader.skipValue(token)) return false;
+            }
+        } else if (!reader.skipValue(token)) {
+            return false;
+        }
+    }
+    if (!hasNodeId || !hasLabel) {
+        deserializeErrors.push_back("Document contains invalid connection. Missing nodeId, socketLabel or socketArrayIndices, or nodeId is not an int, or socketLabel is not a string, or socketArrayIndices is not an array.");
+        path.nodeId = (size_t)-1;
+    }
+    return true;
+}
+
+bool GraphSerializer::readNode(JsonReader& reader, Node*& node) {
+    node = nullptr;
+    // The type may come after the sockets, so sockets of the current node are held on to until the node is complete.
+    struct PendingSocket {
+        std::string type;
+        std::string label;
+        TTJson::Value value;
+        bool hasValue;
+        bool isOutput;
+    };
+    std::vector<PendingSocket> sockets;
+    std::string type;
+    std::string label;
+    bool hasType = false;
+
+    while (true) {
+        JsonReader::Token token = reader.next();
+        if (token == JsonReader::Token::EndObject) break;
+        if (token != JsonReader::Token::Key) return false;
+        std::string key = reader.string();
+        token = reader.next();
+        if (key == "type" && token == JsonReader::Token::String) {
+            type = reader.string();
+            hasType = true;
+        } else if (key == "label" && token == JsonReader::Token::String) {
+            label = reader.string();
+        } else if ((key == "inputs" || key == "outputs") && token == JsonReader::Token::BeginArray) {
+            while ((token = reader.next()) != JsonReader::Token::EndArray) {
+                if (token != JsonReader::Token::BeginObject) {
+                    deserializeErrors.push_back("Node " + key + " in document must be an array of objects. Found something else for node: " + label);
+                    if (!reader.skipValue(token)) return false;
+                    continue;
+                }
+                PendingSocket socket { "", "", TTJson::Value(), false, key == "outputs" };
+                bool hasSocketType = false;
+                bool hasSocketLabel = false;
+                while ((token = reader.next()) != JsonReader::Token::EndObject) {
+                    if (token != JsonReader::Token::Key) return false;
+                    std::string socketKey = reader.string();
+                    token = reader.next();
+                    if (socketKey == "type" && token == JsonReader::Token::String) {
+                        socket.type = reader.string();
+                        hasSocketType = true;
+                    } else if (socketKey == "label" && token == JsonReader::Token::String) {
+                        socket.label = reader.string();
+                        hasSocketLabel = true;
+                    } else if (socketKey == "value") {
+                        if (!reader.readValue(token, socket.value)) return false;
+                        socket.hasValue = true;
+                    } else if (!reader.skipValue(token)) {
+                        return false;
+                    }
+                }
+                if (!hasSocketType || !hasSocketLabel) {
+                    deserializeErrors.push_back("Document missing type or label entry, or entries are not strings, for socket on node: " + label);
+                    continue;
+                }
+                sockets.push_back(std::move(socket));
+            }
+        } else if (!reader.skipValue(token)) {
+            return false;
+        }
+    }
+
+    if (!hasType) {
+        deserializeErrors.push_back("Document missing type for nodes entry.");
+        return true;
+    }
+    Node* spawned = createNode(type, label);
+    if (!spawned)
+        return true;
+    Node& instance = *spawned;
+    // Inputs first, matching the order the TTJson path creates sockets in.
+    for (bool isOutput : { false, true }) {
+        for (const PendingSocket& socket : sockets) {
+            if (socket.isOutput != isOutput) continue;
+            ISocket* into = findOrCreateSocket(instance, socket.type, socket.label, isOutput);
+            if (into && socket.hasValue)
+                into->deserializeValue(socket.value);
+        }
+    }
+    node = &instance;
+    return true;
+}
+
+bool GraphSerializer::readNodes(JsonReader& reader, std::vector<Node*>& graph) {
+    JsonReader::Token token;
+    while ((token = reader.next()) != JsonReader::Token::EndArray) {
+        if (token != JsonReader::Token::BeginObject) {
+            deserializeErrors.push_back("Document contains invalid nodes entry. Must be an object.");
+            graph.push_back(nullptr);
+            if (!reader.skipValue(token)) return false;
+            continue;
+        }
+        Node* node;
+        if (!readNode(reader, node))
+            return false; // malformed json
+        graph.push_back(node);
+    }
+    return true;
+}
+
+bool GraphSerializer::readConnections(JsonReader& reader, const std::vector<Node*>& graph, std::vector<std::pair<SocketPath, SocketPath>>& pending) {
+    JsonReader::Token token;
+    while ((token = reader.next()) != JsonReader::Token::EndArray) {
+        if (token != JsonReader::Token::BeginObject) {
+            if (!reader.skipValue(token)) return false;
+            continue;
+        }
+        SocketPath source { (size_t)-1, "", {} };
+        SocketPath destination { (size_t)-1, "", {} };
+        bool hasSource = false;
+        bool hasDestination = false;
+        while ((token = reader.next()) != JsonReader::Token::EndObject) {
+            if (token != JsonReader::Token::Key) return false;
+            if (reader.string() == "source") {
+                if (!readSocketPath(reader, source)) return false;
+                hasSource = true;
+            } else if (reader.string() == "destination") {
+                if (!readSocketPath(reader, destination)) return false;
+                hasDestination = true;
+            } else if (!reader.skipValue(reader.next())) {
+                return false;
+            }
+        }
+        if (!hasSource || !hasDestination || source.nodeId == (size_t)-1 || destination.nodeId == (size_t)-1)
+            continue;
+
+        // Connect right away if both nodes exist, otherwise wait for the nodes section.
+        if (source.nodeId >= graph.size() || destination.nodeId >= graph.size()) {
+            pending.push_back({ std::move(source), std::move(destination) });
+            continue;
+        }
+        ISocket* sourceSocket = findSocket(source, graph);
+        ISocket* destinationSocket = findSocket(destination, graph);
+        if (sourceSocket && destinationSocket)
+            connect(*sourceSocket, *destinationSocket);
+    }
+    return true;
+}
+
+std::vector<Node*> GraphSerializer::deserializeGraph(std::istream& in) {
+    JsonReader reader(in);
+    std::vector<Node*> graph;
+    std::vector<std::pair<SocketPath, SocketPath>> pending;
+
+    if (reader.next() != JsonReader::Token::BeginObject) {
+        deserializeErrors.push_back("Document root must be an object.");
+        return {};
+    }
+
+    bool ok = true;
+    JsonReader::Token token;
+    while (ok && (token = reader.next()) != JsonReader::Token::EndObject) {
+        if (token != JsonReader::Token::Key) {
+            ok = false;
+            break;
+        }
+        std::string key = reader.string();
+        token = reader.next();
+        if (key == "nodes" && token == JsonReader::Token::BeginArray)
+            ok = readNodes(reader, graph);
+        else if (key == "connections" && token == JsonReader::Token::BeginArray)
+            ok = readConnections(reader, graph, pending);
+        else
+            ok = reader.skipValue(token);
+    }
+
+    if (!ok) {
+        deserializeErrors.push_back("Document is not valid json. " + reader.error());
+        return graph;
+    }
+
+    for (const auto& pair : pending) {
+        ISocket* source = findSocket(pair.first, graph);
+        ISocket* destination = findSocket(pair.second, graph);
+        if (source && destination)
+            connect(*source, *destination);
     }
     return graph;
 }
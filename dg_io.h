@@ -1,6 +1,13 @@
 #pragma once
 
 #include "dg.h"
+#include "dg_binary.h"
+#include "dg_registry.h"
+
+#include <iosfwd>
+
+class JsonReader;
+class JsonWriter;
 
 /*
 Example json:
@@ -54,23 +61,49 @@ private:
     TTJson::Object serialize(const ISocket& socket, const SocketPath& path);
     TTJson::Object serialize(const Node& node, size_t nodeId);
 
-    ISocket* findSocket(const std::vector<ISocket*>& sockets, const std::string& label, const std::vector<size_t>& indices);
     ISocket* findSocket(const Node& node, const std::string& label, const std::vector<size_t>& indices);
+    Node* createNode(const std::string& type, const std::string& label);
+    ISocket* findOrCreateSocket(Node& node, const std::string& type, const std::string& label, bool isOutput);
+    ISocket* findArrayElement(ISocket* socket, const BinaryGraph& graph, const BinaryGraphSocketPath& path);
     void deserializeSocket(const TTJson::Object& socketObj, Node& node, bool isOutput);
     Node* deserializeNode(const TTJson::Object& nodeObj);
     ISocket* deserializeSocketPath(const TTJson::Object& connectionObj, const std::vector<Node*>& nodes);
+    ISocket* findSocket(const SocketPath& path, const std::vector<Node*>& nodes);
+    void connect(ISocket& source, ISocket& destination);
+
+    // Streaming
+    bool findSocketPath(const ISocket& socket, const ISocket& candidate, std::vector<size_t>& indices);
+    void writeInputConnections(JsonWriter& writer, const ISocket& socket, const SocketPath& path, const std::unordered_map<const Node*, size_t>& nodeIds);
+    void write(JsonWriter& writer, const SocketPath& path);
+    void write(JsonWriter& writer, const ISocket& socket);
+    bool readSocketPath(JsonReader& reader, SocketPath& path);
+    // Returns false if the json is malformed. Otherwise node is the created node, or null if the entry was not a valid node.
+    bool readNode(JsonReader& reader, Node*& node);
+    bool readNodes(JsonReader& reader, std::vector<Node*>& graph);
+    bool readConnections(JsonReader& reader, const std::vector<Node*>& graph, std::vector<std::pair<SocketPath, SocketPath>>& pending);
 
 public:
     TTJson::Object serialize(const std::vector<Node*>& nodes);
+    // Writes the same document as above straight to the stream, without building it in memory first.
+    void serialize(const std::vector<Node*>& nodes, std::ostream& out);
+    // See dg_binary.h, use jsonToBinaryGraph and binaryGraphToJson to convert between the formats.
+    std::vector<char> serializeBinary(const std::vector<Node*>& nodes);
 
     typedef std::function<Node& (const std::string& label)> nodeCreatorFn;
     typedef std::function<ISocket* (const std::string& label, bool isOutput, Node& node)> socketCreatorFn;
 
-    // TODO: how are we going to fill this without a ton of manual bookkeeping?
+    // Types registered with TT_DG_REGISTER_NODE / TT_DG_REGISTER_SOCKET (see dg_registry.h) are found without these.
+    // The factories are only consulted for types that are not registered, e.g. because they need extra constructor arguments.
     std::unordered_map<std::string, nodeCreatorFn> nodeFactory;
     std::unordered_map<std::string, socketCreatorFn> socketFactory;
+    // Registered node types are created in this arena. If null they are allocated with new and owned by the caller.
+    GraphArena* arena = nullptr;
 
     std::vector<Node*> deserializeGraph(const TTJson::Value& document);
+    std::vector<Node*> deserializeGraph(const BinaryGraph& graph);
+    // Reads the json document token by token, instantiating nodes as they are encountered.
+    // Only connections to nodes that have not been read yet are held on to.
+    std::vector<Node*> deserializeGraph(std::istream& in);
 
     std::vector<std::string> deserializeErrors;
 };
@@ -0,0 +1,362 @@
+#include "dg_json_stream.h"
+
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+
+/// Reading
+JsonReader::Token JsonReader::fail(const std::string& message) {
+    if (_error.empty())
+        _error = message;
+    return Token::Error;
+}
+
+void JsonReader::skipWhitespace() {
+    while (true) {
+        int c = _in.peek();
+        if (c == EOF) return;
+        if (std::isspace(c)) {
+            _in.get();
+            continue;
+        }
+        if (c != '/') return;
+        _in.get();
+        int kind = _in.get();
+        if (kind == '/') {
+            while (_in.peek() != EOF && _in.peek() != '\n')
+                _in.get();
+        } else if (kind == '*') {
+            int previous = 0;
+            while (true) {
+                int d = _in.get();
+                if (d == EOF || (previous == '*' && d == '/')) break;
+                previous = d;
+            }
+        } else {
+            // Not a comment, let the caller trip over it.
+            _in.unget();
+            _in.unget();
+            return;
+        }
+    }
+}
+
+bool JsonReader::readString(char quote) {
+    _string.clear();
+    while (true) {
+        int c = _in.get();
+        if (c == EOF) return false;
+        if (c == quote) return true;
+        if (c != '\\') {
+            _string += (char)c;
+            continue;
+        }
+        c = _in.get();
+        switch (c) {
+        case 'n': _string += '\n'; break;
+        case 't': _string += '\t'; break;
+        case 'r': _string += '\r'; break;
+        case 'b': _string += '\b'; break;
+        case 'f': _string += '\f'; break;
+        case '\n': break; // json5 line continuation
+        case 'u': {
+            unsigned int code = 0;
+            for (int i = 0; i < 4; ++i) {
+                int h = _in.get();
+                if (!std::isxdigit(h)) return false;
+                code = code * 16 + (std::isdigit(h) ? h - '0' : std::tolower(h) - 'a' + 10);
+            }
+            // Encode as utf-8, surrogate pairs are passed through as is.
+            if (code < 0x80) {
+                _string += (char)code;
+            } else if (code < 0x800) {
+                _string += (char)(0xC0 | (code >> 6));
+                _string += (char)(0x80 | (code & 0x3F));
+            } else {
+                _string += (char)(0xE0 | (code >> 12));
+                _string += (char)(0x80 | ((code >> 6) & 0x3F));
+                _string += (char)(0x80 | (code & 0x3F));
+            }
+            break;
+        }
+        case EOF: return false;
+        default: _string += (char)c; break;
+        }
+    }
+}
+
+bool JsonReader::readIdentifier() {
+    _string.clear();
+    while (true) {
+        int c = _in.peek();
+        if (c == EOF || !(std::isalnum(c) || c == '_' || c == '$')) break;
+        _string += (char)_in.get();
+    }
+    return !_string.empty();
+}
+
+JsonReader::Token JsonReader::readLiteral() {
+    std::string literal;
+    while (true) {
+        int c = _in.peek();
+        if (c == EOF || !(std::isalnum(c) || c == '+' || c == '-' || c == '.')) break;
+        literal += (char)_in.get();
+    }
+    if (literal == "null") return Token::Null;
+    if (literal == "true" || literal == "false") {
+        _bool = literal == "true";
+        return Token::Bool;
+    }
+    if (literal.empty())
+        return fail("Unexpected character in json document.");
+
+    const char* begin = literal.c_str();
+    char* end = nullptr;
+    bool hex = literal.find("0x") != std::string::npos || literal.find("0X") != std::string::npos;
+    if (hex || literal.find_first_of(".eEIN") == std::string::npos) {
+        _int = std::strtoll(begin, &end, hex ? 16 : 10);
+        if (*end == '\0') return Token::Int;
+    }
+    _double = std::strtod(begin, &end);
+    if (*end != '\0')
+        return fail("Invalid number in json document: " + literal);
+    return Token::Double;
+}
+
+JsonReader::Token JsonReader::next() {
+    if (!_error.empty())
+        return Token::Error;
+
+    while (true) {
+        skipWhitespace();
+        int c = _in.peek();
+        if (c == EOF)
+            return _stack.empty() ? Token::End : fail("Unexpected end of json document.");
+
+        if (c == ',') {
+            _in.get();
+            _expectKey = !_stack.empty() && _stack.back() == '{';
+            continue;
+        }
+
+        if (c == '}' || c == ']') {
+            _in.get();
+            if (_stack.empty() || _stack.back() != (c == '}' ? '{' : '['))
+                return fail("Mismatched brackets in json document.");
+            _stack.pop_back();
+            _expectKey = false;
+            return c == '}' ? Token::EndObject : Token::EndArray;
+        }
+
+        if (_expectKey) {
+            bool ok;
+            if (c == '"' || c == '\'') {
+                _in.get();
+                ok = readString((char)c);
+            } else {
+                ok = readIdentifier();
+            }
+            skipWhitespace();
+            if (!ok || _in.get() != ':')
+                return fail("Invalid key in json document.");
+            _expectKey = false;
+            return Token::Key;
+        }
+
+        if (c == '{' || c == '[') {
+            _in.get();
+            _stack.push_back((char)c);
+            _expectKey = c == '{';
+            return c == '{' ? Token::BeginObject : Token::BeginArray;
+        }
+
+        if (c == '"' || c == '\'') {
+            _in.get();
+            if (!readString((char)c))
+                return fail("Unterminated string in json document.");
+            return Token::String;
+        }
+
+        return readLiteral();
+    }
+}
+
+bool JsonReader::readValue(Token first, TTJson::Value& result) {
+    return readValue(first, result, 0);
+}
+
+bool JsonReader::readValue(Token first, TTJson::Value& result, uint32_t depth) {
+    if ((first == Token::BeginArray || first == Token::BeginObject) && depth >= sMaxValueDepth) {
+        fail("Value nested too deeply in json document.");
+        return false;
+    }
+    switch (first) {
+    case Token::Null: result = TTJson::Value(); return true;
+    // Sockets only deal in numbers and strings, so booleans are read as ints.
+    case Token::Bool: result = (long long)_bool; return true;
+    case Token::Int: result = _int; return true;
+    case Token::Double: result = _double; return true;
+    case Token::String: result = (TTJson::str_t)_string; return true;
+    case Token::BeginArray: {
+        TTJson::Array array;
+        while (true) {
+            Token token = next();
+            if (token == Token::EndArray) break;
+            TTJson::Value element;
+            if (!readValue(token, element, depth + 1)) return false;
+            array.push_back(element);
+        }
+        result = array;
+        return true;
+    }
+    case Token::BeginObject: {
+        TTJson::Object object;
+        while (true) {
+            Token token = next();
+            if (token == Token::EndObject) break;
+            if (token != Token::Key) return false;
+            std::string key = _string;
+            TTJson::Value element;
+            if (!readValue(next(), element, depth + 1)) return false;
+            object[key] = element;
+        }
+        result = object;
+        return true;
+    }
+    default:
+        fail("Unexpected token in json document.");
+        return false;
+    }
+}
+
+bool JsonReader::skipValue(Token first) {
+    if (first == Token::Error || first == Token::End || first == Token::EndObject || first == Token::EndArray || first == Token::Key)
+        return false;
+    if (first != Token::BeginObject && first != Token::BeginArray)
+        return true;
+    size_t depth = 1;
+    while (depth) {
+        Token token = next();
+        if (token == Token::Error || token == Token::End) return false;
+        if (token == Token::BeginObject || token == Token::BeginArray) ++depth;
+        if (token == Token::EndObject || token == Token::EndArray) --depth;
+    }
+    return true;
+}
+
+/// Writing
+void JsonWriter::separate() {
+    if (_afterKey) {
+        _afterKey = false;
+        return;
+    }
+    if (_hasElements.empty()) return;
+    if (_hasElements.back())
+        _out << ',';
+    _hasElements.back() = true;
+}
+
+void JsonWriter::writeString(const std::string& str) {
+    _out << '"';
+    for (char c : str) {
+        switch (c) {
+        case '"': _out << "\\\""; break;
+        case '\\': _out << "\\\\"; break;
+        case '\n': _out << "\\n"; break;
+        case '\r': _out << "\\r"; break;
+        case '\t': _out << "\\t"; break;
+        default:
+            if ((unsigned char)c < 0x20) {
+                char buffer[8];
+                snprintf(buffer, sizeof(buffer), "\\u%04x", (unsigned char)c);
+                _out << buffer;
+            } else {
+                _out << c;
+            }
+        }
+    }
+    _out << '"';
+}
+
+void JsonWriter::beginObject() {
+    separate();
+    _out << '{';
+    _hasElements.push_back(false);
+}
+
+void JsonWriter::endObject() {
+    _hasElements.pop_back();
+    _out << '}';
+}
+
+void JsonWriter::beginArray() {
+    separate();
+    _out << '[';
+    _hasElements.push_back(false);
+}
+
+void JsonWriter::endArray() {
+    _hasElements.pop_back();
+    _out << ']';
+}
+
+void JsonWriter::key(const std::string& key) {
+    separate();
+    writeString(key);
+    _out << ':';
+    _afterKey = true;
+}
+
+void JsonWriter::value(const std::string& value) {
+    separate();
+    writeString(value);
+}
+
+void JsonWriter::value(long long value) {
+    separate();
+    _out << value;
+}
+
+void JsonWriter::value(double value) {
+    separate();
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%.17g", value);
+    _out << buffer;
+    // Make sure it reads back as a double.
+    std::string str(buffer);
+    if (str.find_first_of(".eEni") == std::string::npos)
+        _out << ".0";
+}
+
+void JsonWriter::value(bool value) {
+    separate();
+    _out << (value ? "true" : "false");
+}
+
+void JsonWriter::null() {
+    separate();
+    _out << "null";
+}
+
+void JsonWriter::raw(const std::string& json) {
+    separate();
+    _out << json;
+}
+
+void JsonWriter::value(const TTJson::Value& value) {
+    if (value.isInt()) {
+        this->value((long long)value.asInt());
+    } else if (value.isDouble()) {
+        this->value((double)value.asDouble());
+    } else if (value.isString()) {
+        this->value((std::string)value.asString());
+    } else if (value.isArray()) {
+        beginArray();
+        for (const auto& element : value.asArray())
+            this->value(element);
+        endArray();
+    } else {
+        // Sockets do not serialize objects, anything else we do not know about is written as null.
+        null();
+    }
+}
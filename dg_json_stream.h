@@ -0,0 +1,85 @@
+#pragma once
+
+#include "../tt_cpplib/tt_json5.h"
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Pull parser that hands out one json token at a time, so a document can be consumed without building a TTJson::Value tree for it.
+// Accepts the json5 conveniences our files may use: comments, trailing commas, unquoted keys and single quoted strings.
+class JsonReader {
+public:
+    enum class Token { BeginObject, EndObject, BeginArray, EndArray, Key, String, Int, Double, Bool, Null, End, Error };
+
+private:
+    std::istream& _in;
+    // '{' or '[' for every container we are in.
+    std::vector<char> _stack;
+    bool _expectKey = false;
+    std::string _string;
+    long long _int = 0;
+    double _double = 0.0;
+    bool _bool = false;
+    std::string _error;
+
+    void skipWhitespace();
+    bool readString(char quote);
+    bool readIdentifier();
+    Token readLiteral();
+    Token fail(const std::string& message);
+    bool readValue(Token first, TTJson::Value& result, uint32_t depth);
+
+public:
+    // Values nested deeper than this are rejected, so a malformed document can not exhaust the stack. Same as BinaryGraph::sMaxValueDepth.
+    static constexpr uint32_t sMaxValueDepth = 64;
+
+    explicit JsonReader(std::istream& in) : _in(in) {}
+
+    Token next();
+
+    // Reads the remainder of the value that started with the given token, e.g. to hand a socket value to ISocket::deserializeValue.
+    bool readValue(Token first, TTJson::Value& result);
+    // Skips the remainder of the value that started with the given token.
+    bool skipValue(Token first);
+
+    // Valid after Key and String tokens.
+    const std::string& string() const { return _string; }
+    long long intValue() const { return _int; }
+    double doubleValue() const { return _double; }
+    bool boolValue() const { return _bool; }
+    const std::string& error() const { return _error; }
+};
+
+// Writes json straight to a stream, taking care of the separators.
+class JsonWriter {
+private:
+    std::ostream& _out;
+    // For every open container, whether it has received an element yet.
+    std::vector<bool> _hasElements;
+    bool _afterKey = false;
+
+    void separate();
+    void writeString(const std::string& str);
+
+public:
+    explicit JsonWriter(std::ostream& out) : _out(out) {}
+
+    void beginObject();
+    void endObject();
+    void beginArray();
+    void endArray();
+    void key(const std::string& key);
+    void value(const std::string& value);
+    void value(const char* value) { this->value(std::string(value)); }
+    void value(long long value);
+    void value(double value);
+    void value(bool value);
+    void null();
+    // Writes a value that is already serialized, e.g. by another JsonWriter.
+    void raw(const std::string& json);
+    // Writes a (small) value tree, e.g. the result of ISocket::serializeValue.
+    void value(const TTJson::Value& value);
+};
@@ -0,0 +1,116 @@
+#include "dg_memo.h"
+
+bool MemoCache::appendInputKey(const ISocket& socket, std::string& key) {
+    // Follow connections to where the value really lives.
+    const ISocket* source = &socket;
+    while (source->_getInput())
+        source = source->_getInput();
+
+    if (source == &socket || !source->isOutput()) {
+        key += 'V';
+        return source->_appendValueKey(key);
+    }
+
+    // The upstream id is only known once it computed.
+    source->node().compute();
+
+    if (source->_memoId) {
+        key += 'M';
+        key.append((const char*)&source->_memoId, sizeof(uint64_t));
+        return true;
+    }
+
+    key += 'P';
+    key.append((const char*)&source, sizeof(const ISocket*));
+    key.append((const char*)&source->_changedAt, sizeof(uint64_t));
+    return true;
+}
+
+bool MemoCache::buildKey(const Node& node, std::string& key) {
+    key = node.typeName();
+    key += '\0';
+    // Nodes may have grown extra outputs, entries must match in shape.
+    size_t outputCount = node._outputs.size();
+    key.append((const char*)&outputCount, sizeof(size_t));
+    for (const ISocket* socket : node._inputs) {
+        if (!socket->isArray()) {
+            if (!appendInputKey(*socket, key))
+                return false;
+            continue;
+        }
+        const auto& children = ((const ISocketArray*)socket)->_children;
+        size_t count = children.size();
+        key.append((const char*)&count, sizeof(size_t));
+        for (const ISocket* child : children)
+            if (!appendInputKey(*child, key))
+                return false;
+    }
+    return true;
+}
+
+void MemoCache::compute(Node& node) {
+    std::string key;
+    if (!buildKey(node, key)) {
+        for (ISocket* socket : node._outputs)
+            socket->_memoId = 0;
+        node._compute();
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _lookup.find(key);
+        if (it != _lookup.end()) {
+            ++_hits;
+            _entries.splice(_entries.begin(), _entries, it->second);
+            const Entry& entry = *it->second;
+            for (size_t i = 0; i < node._outputs.size(); ++i) {
+                node._outputs[i]->_loadValue(entry.outputs[i]);
+                node._outputs[i]->_memoId = entry.firstId + i;
+            }
+            return;
+        }
+        ++_misses;
+    }
+
+    // Compute outside of the lock, other threads may be looking up their own nodes meanwhile.
+    node._compute();
+
+    Entry entry { std::move(key), {}, 0 };
+    for (const ISocket* socket : node._outputs) {
+        entry.outputs.push_back(socket->_saveValue());
+        if (!entry.outputs.back()) {
+            // E.g. an array output, we can not restore this node.
+            for (ISocket* output : node._outputs)
+                output->_memoId = 0;
+            return;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    // Another thread may have computed the same key in the meantime, in which case we keep theirs.
+    auto it = _lookup.find(entry.key);
+    if (it == _lookup.end()) {
+        while (!_entries.empty() && _entries.size() >= _maxEntries) {
+            _lookup.erase(_entries.back().key);
+            _entries.pop_back();
+        }
+        entry.firstId = _nextId;
+        _nextId += entry.outputs.size();
+        _entries.push_front(std::move(entry));
+        it = _lookup.emplace(_entries.front().key, _entries.begin()).first;
+    }
+    for (size_t i = 0; i < node._outputs.size(); ++i)
+        node._outputs[i]->_memoId = it->second->firstId + i;
+}
+
+void MemoCache::clear() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _entries.clear();
+    _lookup.clear();
+}
+
+size_t MemoCache::size() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _entries.size();
+}
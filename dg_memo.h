@@ -0,0 +1,50 @@
+#pragma once
+
+#include "dg.h"
+
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+// Shares the outputs of cacheable nodes (see Node::cacheable) between computes with the same inputs.
+// The key is the node type, the values of unconnected inputs, and for connected inputs an id of the upstream value:
+// either the cache entry it came from, so identical subgraphs map to the same keys all the way down,
+// or the upstream socket and the revision it last changed at.
+// Keys are compared in full, there are no hash collisions to worry about.
+// Entries are evicted least recently used first to stay within maxEntries (but at least one).
+// Safe to use from multiple threads, e.g. with GraphSchedule::evaluateParallel.
+class MemoCache {
+private:
+    struct Entry {
+        std::string key;
+        std::vector<std::shared_ptr<void>> outputs;
+        // Output i of the entry gets id firstId + i.
+        uint64_t firstId;
+    };
+
+    std::mutex _mutex;
+    // Most recently used first.
+    std::list<Entry> _entries;
+    std::unordered_map<std::string, std::list<Entry>::iterator> _lookup;
+    size_t _maxEntries;
+    uint64_t _nextId = 1;
+    size_t _hits = 0;
+    size_t _misses = 0;
+
+    static bool appendInputKey(const ISocket& socket, std::string& key);
+    static bool buildKey(const Node& node, std::string& key);
+
+public:
+    explicit MemoCache(size_t maxEntries = 1024) : _maxEntries(maxEntries) {}
+
+    // Called by Node::compute for cacheable nodes. Runs _compute if the inputs are not in the cache (or can not be keyed).
+    void compute(Node& node);
+
+    void clear();
+    size_t size();
+    size_t hits() const { return _hits; }
+    size_t misses() const { return _misses; }
+
+    MemoCache(const MemoCache& rhs) = delete;
+    MemoCache& operator=(const MemoCache& rhs) = delete;
+};
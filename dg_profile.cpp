@@ -0,0 +1,157 @@
+#include "dg_profile.h"
+
+#ifdef TT_DG_PROFILE
+
+#include "dg.h"
+#include "dg_json_stream.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <ostream>
+
+namespace {
+    thread_local NodeProfiler::Scope* tCurrentScope = nullptr;
+    thread_local uint32_t tThreadIndex = 0;
+}
+
+NodeProfiler& NodeProfiler::instance() {
+    static NodeProfiler profiler;
+    return profiler;
+}
+
+NodeProfiler::Stats& NodeProfiler::_statsFor(const Node& node, uint32_t* index) {
+    auto it = _lookup.find(&node);
+    if (it == _lookup.end()) {
+        it = _lookup.emplace(&node, (uint32_t)_stats.size()).first;
+        _stats.emplace_back();
+        _stats.back().name = node.typeName() + (node.label().empty() ? "" : " " + node.label());
+    }
+    if (index) *index = it->second;
+    return _stats[it->second];
+}
+
+NodeProfiler::Scope::Scope(const Node& node)
+    : _node(node), _start(std::chrono::steady_clock::now()), _parent(tCurrentScope) {
+    tCurrentScope = this;
+}
+
+NodeProfiler::Scope::~Scope() {
+    auto end = std::chrono::steady_clock::now();
+    double ms = std::chrono::duration<double, std::milli>(end - _start).count();
+    tCurrentScope = _parent;
+    if (_parent)
+        _parent->_childMs += ms;
+
+    NodeProfiler& profiler = instance();
+    std::lock_guard<std::mutex> lock(profiler._mutex);
+    if (!tThreadIndex)
+        tThreadIndex = ++profiler._threadCount;
+    uint32_t index;
+    Stats& stats = profiler._statsFor(_node, &index);
+    if (_skipped)
+        stats.skips++;
+    else
+        stats.computes++;
+    stats.inclusiveMs += ms;
+    stats.exclusiveMs += ms - _childMs;
+    if (profiler._events.size() >= profiler._maxEvents) {
+        profiler._droppedEvents++;
+        return;
+    }
+    double startUs = std::chrono::duration<double, std::micro>(_start - profiler._epoch).count();
+    profiler._events.push_back({ index, stats.lastTrigger, tThreadIndex, startUs, ms * 1000.0 });
+}
+
+void NodeProfiler::recordDirty(const Node& node, const ISocket& trigger) {
+    NodeProfiler& profiler = instance();
+    std::lock_guard<std::mutex> lock(profiler._mutex);
+    Stats& stats = profiler._statsFor(node);
+    stats.dirtyHits++;
+    stats.lastTrigger = trigger.labelId();
+}
+
+void NodeProfiler::clear() {
+    NodeProfiler& profiler = instance();
+    std::lock_guard<std::mutex> lock(profiler._mutex);
+    profiler._lookup.clear();
+    profiler._stats.clear();
+    profiler._events.clear();
+    profiler._droppedEvents = 0;
+    profiler._epoch = std::chrono::steady_clock::now();
+}
+
+void NodeProfiler::setMaxEvents(size_t maxEvents) {
+    NodeProfiler& profiler = instance();
+    std::lock_guard<std::mutex> lock(profiler._mutex);
+    profiler._maxEvents = maxEvents;
+}
+
+size_t NodeProfiler::droppedEvents() {
+    NodeProfiler& profiler = instance();
+    std::lock_guard<std::mutex> lock(profiler._mutex);
+    return profiler._droppedEvents;
+}
+
+std::vector<NodeProfiler::Stats> NodeProfiler::stats() {
+    NodeProfiler& profiler = instance();
+    std::vector<Stats> result;
+    {
+        std::lock_guard<std::mutex> lock(profiler._mutex);
+        result = profiler._stats;
+    }
+    std::stable_sort(result.begin(), result.end(), [](const Stats& a, const Stats& b) { return a.exclusiveMs > b.exclusiveMs; });
+    return result;
+}
+
+void NodeProfiler::writeChromeTrace(std::ostream& out) {
+    NodeProfiler& profiler = instance();
+    std::lock_guard<std::mutex> lock(profiler._mutex);
+    JsonWriter writer(out);
+    writer.beginObject();
+    writer.key("displayTimeUnit");
+    writer.value("ms");
+    writer.key("traceEvents");
+    writer.beginArray();
+    for (const Event& event : profiler._events) {
+        writer.beginObject();
+        writer.key("name");
+        writer.value(profiler._stats[event.stats].name);
+        writer.key("cat");
+        writer.value("compute");
+        writer.key("ph");
+        writer.value("X");
+        writer.key("pid");
+        writer.value(0ll);
+        writer.key("tid");
+        writer.value((long long)event.thread);
+        writer.key("ts");
+        writer.value(event.startUs);
+        writer.key("dur");
+        writer.value(event.durationUs);
+        writer.key("args");
+        writer.beginObject();
+        writer.key("trigger");
+        writer.value(SymbolTable::name(event.trigger));
+        writer.endObject();
+        writer.endObject();
+    }
+    writer.endArray();
+    writer.endObject();
+}
+
+void NodeProfiler::writeSummary(std::ostream& out, size_t count) {
+    std::vector<Stats> all = stats();
+    char line[256];
+    snprintf(line, sizeof(line), "%12s %12s %10s %10s %10s  %s\n", "exclusive ms", "inclusive ms", "computes", "skipped", "dirtied", "node (last trigger)");
+    out << line;
+    for (size_t i = 0; i < all.size() && i < count; ++i) {
+        const Stats& stats = all[i];
+        snprintf(line, sizeof(line), "%12.3f %12.3f %10zu %10zu %10zu  ", stats.exclusiveMs, stats.inclusiveMs, stats.computes, stats.skips, stats.dirtyHits);
+        out << line << stats.name;
+        if (stats.lastTrigger)
+            out << " (" << SymbolTable::name(stats.lastTrigger) << ")";
+        out << '\n';
+    }
+}
+
+#endif
@@ -0,0 +1,105 @@
+#pragma once
+
+// Per node evaluation statistics and a timeline of computes, to find out where evaluation time goes.
+// Only compiled in when TT_DG_PROFILE is defined. Otherwise the hooks below expand to nothing and NodeProfiler does not exist,
+// so release builds pay nothing for it.
+
+#ifdef TT_DG_PROFILE
+
+#include "dg_symbols.h"
+
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class ISocket;
+class Node;
+
+class NodeProfiler {
+public:
+    struct Stats {
+        // Type name and label, copied so the stats outlive the node.
+        std::string name;
+        size_t computes = 0;
+        // Computes that found all inputs unchanged and did not run, see Socket::sEarlyCutoff. Their time is still counted.
+        size_t skips = 0;
+        // Time spent computing the node, with and without the computes of upstream nodes it pulled on the way.
+        double inclusiveMs = 0.0;
+        double exclusiveMs = 0.0;
+        // How often dirtiness reached the node, and through which of its inputs it did so last.
+        size_t dirtyHits = 0;
+        Symbol lastTrigger = 0;
+    };
+
+    // Times one compute, nested scopes on the same thread are subtracted from the exclusive time.
+    class Scope {
+    private:
+        const Node& _node;
+        std::chrono::steady_clock::time_point _start;
+        double _childMs = 0.0;
+        Scope* _parent;
+        bool _skipped = false;
+
+    public:
+        explicit Scope(const Node& node);
+        ~Scope();
+
+        void skipped() { _skipped = true; }
+
+        Scope(const Scope& rhs) = delete;
+        Scope& operator=(const Scope& rhs) = delete;
+    };
+
+    static void recordDirty(const Node& node, const ISocket& trigger);
+    // Clears stats and events. Call it between frames or runs, the timeline stops recording once it holds maxEvents.
+    static void clear();
+    static void setMaxEvents(size_t maxEvents);
+    // Computes left out of the timeline since the last clear, because it was full. Their stats are still recorded.
+    static size_t droppedEvents();
+    // Sorted by exclusive time, most expensive first.
+    static std::vector<Stats> stats();
+    // Chrome trace event format, open it in chrome://tracing or ui.perfetto.dev.
+    static void writeChromeTrace(std::ostream& out);
+    // Human readable table of the count most expensive nodes.
+    static void writeSummary(std::ostream& out, size_t count = 20);
+
+private:
+    struct Event {
+        uint32_t stats;
+        Symbol trigger;
+        uint32_t thread;
+        double startUs;
+        double durationUs;
+    };
+
+    std::mutex _mutex;
+    std::chrono::steady_clock::time_point _epoch;
+    // Nodes are identified by address, so clear() between graphs if nodes are deleted and new ones may reuse it.
+    std::unordered_map<const Node*, uint32_t> _lookup;
+    std::vector<Stats> _stats;
+    std::vector<Event> _events;
+    size_t _maxEvents = 1 << 20;
+    size_t _droppedEvents = 0;
+    uint32_t _threadCount = 0;
+
+    NodeProfiler() : _epoch(std::chrono::steady_clock::now()) {}
+    static NodeProfiler& instance();
+    // Requires _mutex to be held.
+    Stats& _statsFor(const Node& node, uint32_t* index = nullptr);
+};
+
+#define TT_DG_PROFILE_COMPUTE(node) NodeProfiler::Scope ttDgProfileScope(node)
+#define TT_DG_PROFILE_SKIPPED() ttDgProfileScope.skipped()
+#define TT_DG_PROFILE_DIRTY(node, trigger) NodeProfiler::recordDirty(node, trigger)
+
+#else
+
+#define TT_DG_PROFILE_COMPUTE(node)
+#define TT_DG_PROFILE_SKIPPED()
+#define TT_DG_PROFILE_DIRTY(node, trigger)
+
+#endif
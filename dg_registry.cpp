@@ -0,0 +1,44 @@
+#include "dg_registry.h"
+
+TypeRegistry& TypeRegistry::instance() {
+    static TypeRegistry registry;
+    return registry;
+}
+
+uint32_t TypeRegistry::add(std::vector<uint32_t>& ids, uint32_t next, Symbol name) {
+    if (name >= ids.size())
+        ids.resize(name + 1, 0);
+    if (ids[name] == 0)
+        ids[name] = next + 1;
+    return ids[name] - 1;
+}
+
+uint32_t TypeRegistry::registerNodeType(const std::string& name, NodeCreateFn create) {
+    TypeRegistry& registry = instance();
+    uint32_t id = add(registry._nodeIds, (uint32_t)registry._nodeTypes.size(), SymbolTable::intern(name));
+    if (id == registry._nodeTypes.size())
+        registry._nodeTypes.push_back(create);
+    return id;
+}
+
+uint32_t TypeRegistry::registerSocketType(const std::string& name, SocketCreateFn create) {
+    TypeRegistry& registry = instance();
+    uint32_t id = add(registry._socketIds, (uint32_t)registry._socketTypes.size(), SymbolTable::intern(name));
+    if (id == registry._socketTypes.size())
+        registry._socketTypes.push_back(create);
+    return id;
+}
+
+TypeRegistry::NodeCreateFn TypeRegistry::findNodeType(Symbol name) {
+    const TypeRegistry& registry = instance();
+    if (name >= registry._nodeIds.size() || registry._nodeIds[name] == 0)
+        return nullptr;
+    return registry._nodeTypes[registry._nodeIds[name] - 1];
+}
+
+TypeRegistry::SocketCreateFn TypeRegistry::findSocketType(Symbol name) {
+    const TypeRegistry& registry = instance();
+    if (name >= registry._socketIds.size() || registry._socketIds[name] == 0)
+        return nullptr;
+    return registry._socketTypes[registry._socketIds[name] - 1];
+}
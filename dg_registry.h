@@ -0,0 +1,75 @@
+#pragma once
+
+#include "dg.h"
+
+// Node and socket types register themselves here once at startup (see the macros below), so loading a graph
+// does not need every application to fill GraphSerializer::nodeFactory and socketFactory by hand.
+// Every registered type gets a dense id, and the type name symbol maps straight to it,
+// so a lookup is an array index and a plain function call instead of a string hash and a std::function.
+// Registration is not thread safe, it is meant to happen during static initialization.
+class TypeRegistry {
+public:
+    // Allocates the node in the arena if given, otherwise with new.
+    typedef Node* (*NodeCreateFn)(GraphArena* arena, const std::string& label);
+    typedef ISocket* (*SocketCreateFn)(const std::string& label, bool isOutput, Node& node);
+
+private:
+    std::vector<NodeCreateFn> _nodeTypes;
+    std::vector<SocketCreateFn> _socketTypes;
+    // Indexed by symbol, type id + 1 or 0 if the symbol is not a registered type name.
+    std::vector<uint32_t> _nodeIds;
+    std::vector<uint32_t> _socketIds;
+
+    static TypeRegistry& instance();
+    static uint32_t add(std::vector<uint32_t>& ids, uint32_t next, Symbol name);
+
+    template<typename NodeT> static Node* createNode(GraphArena* arena, const std::string& label) {
+        if (arena)
+            return &arena->create<NodeT>(label);
+        return new NodeT(label);
+    }
+
+    // Initialized by the first call, which is registerSocket.
+    template<typename SocketT> static const typename SocketT::value_t& defaultValue(const typename SocketT::value_t* initialValue = nullptr) {
+        static typename SocketT::value_t value = *initialValue;
+        return value;
+    }
+
+    template<typename SocketT> static ISocket* createSocket(const std::string& label, bool isOutput, Node& node) {
+        return node.createSocket<SocketT>(label, defaultValue<SocketT>(), isOutput, node);
+    }
+
+    template<typename SocketT> static ISocket* createArraySocket(const std::string& label, bool isOutput, Node& node) {
+        return node.createSocket<SocketArray<SocketT>>(label, defaultValue<SocketT>(), isOutput, node);
+    }
+
+public:
+    // Registering the same name twice returns the id of the first registration.
+    static uint32_t registerNodeType(const std::string& name, NodeCreateFn create);
+    static uint32_t registerSocketType(const std::string& name, SocketCreateFn create);
+
+    // The name must match what NodeT::typeName() returns.
+    template<typename NodeT> static uint32_t registerNode(const std::string& name) {
+        return registerNodeType(name, &createNode<NodeT>);
+    }
+
+    // Registers the socket under its sTypeName(), along with the SocketArray of it.
+    // The default value is what deserialized sockets start out with, before the document's value is applied.
+    template<typename SocketT> static uint32_t registerSocket(const typename SocketT::value_t& value) {
+        defaultValue<SocketT>(&value);
+        registerSocketType(SocketArray<SocketT>::sTypeName(), &createArraySocket<SocketT>);
+        return registerSocketType(SocketT::sTypeName(), &createSocket<SocketT>);
+    }
+
+    // Return nullptr if the name is not registered.
+    static NodeCreateFn findNodeType(Symbol name);
+    static SocketCreateFn findSocketType(Symbol name);
+    static NodeCreateFn nodeType(uint32_t id) { return instance()._nodeTypes[id]; }
+    static SocketCreateFn socketType(uint32_t id) { return instance()._socketTypes[id]; }
+};
+
+// Put these in a single source file each, e.g. next to the node's implementation.
+#define TT_DG_REGISTER_NODE(NodeT) \
+    static const uint32_t sNodeTypeId_##NodeT = TypeRegistry::registerNode<NodeT>(#NodeT);
+#define TT_DG_REGISTER_SOCKET(SocketT, defaultValue) \
+    static const uint32_t sSocketTypeId_##SocketT = TypeRegistry::registerSocket<SocketT>(defaultValue);
@@ -0,0 +1,248 @@
+#include "dg_schedule.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+void GraphSchedule::gatherUpstream(const ISocket& socket, std::vector<const ISocket*>& result) {
+    if (socket.isArray()) {
+        for (const ISocket* element : ((const ISocketArray&)socket)._children)
+            gatherUpstream(*element, result);
+        return;
+    }
+    ISocket* input = socket._getInput();
+    if (input && std::find(result.begin(), result.end(), input) == result.end())
+        result.push_back(input);
+}
+
+void GraphSchedule::compile(const std::vector<Node*>& nodes) {
+    _order.clear();
+    _upstreamOffsets.clear();
+    _upstream.clear();
+    _sourceOffsets.clear();
+    _sources.clear();
+    _downstreamOffsets.clear();
+    _downstream.clear();
+    _pullsExternal.clear();
+    _positions.clear();
+
+    // Number the nodes in the order we got them, the document may contain holes for nodes that failed to load.
+    std::vector<Node*> input;
+    input.reserve(nodes.size());
+    std::unordered_map<const Node*, size_t> indices;
+    for (Node* node : nodes) {
+        if (!node || indices.find(node) != indices.end()) continue;
+        indices[node] = input.size();
+        input.push_back(node);
+    }
+
+    // Gather the sockets every node reads from and the unique nodes they belong to, ignoring connections to nodes outside of this set; those are pulled instead.
+    std::vector<std::vector<size_t>> upstream(input.size());
+    std::vector<std::vector<size_t>> downstream(input.size());
+    std::vector<std::vector<const ISocket*>> sources(input.size());
+    std::vector<char> pullsExternal(input.size(), 0);
+    for (size_t i = 0; i < input.size(); ++i) {
+        for (const ISocket* socket : input[i]->_inputs)
+            gatherUpstream(*socket, sources[i]);
+        for (const ISocket* source : sources[i]) {
+            const auto& it = indices.find(&source->node());
+            if (it == indices.end()) {
+                pullsExternal[i] = 1;
+                continue;
+            }
+            if (it->second == i) continue;
+            if (std::find(upstream[i].begin(), upstream[i].end(), it->second) != upstream[i].end()) continue;
+            upstream[i].push_back(it->second);
+            downstream[it->second].push_back(i);
+        }
+    }
+
+    // Nodes keep themselves in topological order as they are connected (see Node::order), so we only have to sort by it.
+    std::vector<size_t> sorted(input.size());
+    for (size_t i = 0; i < input.size(); ++i)
+        sorted[i] = i;
+    std::sort(sorted.begin(), sorted.end(), [&](size_t a, size_t b) { return input[a]->order() < input[b]->order(); });
+
+    // Flatten
+    std::vector<size_t> positionOf(input.size());
+    for (size_t position = 0; position < sorted.size(); ++position)
+        positionOf[sorted[position]] = position;
+
+    _order.reserve(sorted.size());
+    _upstreamOffsets.reserve(sorted.size() + 1);
+    _sourceOffsets.reserve(sorted.size() + 1);
+    _downstreamOffsets.reserve(sorted.size() + 1);
+    for (size_t i : sorted) {
+        size_t position = _order.size();
+        _positions[input[i]] = position;
+        _order.push_back(input[i]);
+        _upstreamOffsets.push_back(_upstream.size());
+        for (size_t j : upstream[i]) {
+            // Setting an input refuses cycles, so this is only a failsafe: drop the edge and let the node pull it instead.
+            if (positionOf[j] >= position) {
+                pullsExternal[i] = 1;
+                continue;
+            }
+            _upstream.push_back(positionOf[j]);
+        }
+        _sourceOffsets.push_back(_sources.size());
+        for (const ISocket* source : sources[i]) {
+            const auto& it = indices.find(&source->node());
+            if (it == indices.end() || it->second == i || positionOf[it->second] >= position) continue;
+            _sources.push_back({ positionOf[it->second], source });
+        }
+        _downstreamOffsets.push_back(_downstream.size());
+        for (size_t j : downstream[i])
+            if (positionOf[j] > position)
+                _downstream.push_back(positionOf[j]);
+        _pullsExternal.push_back(pullsExternal[i]);
+    }
+    _upstreamOffsets.push_back(_upstream.size());
+    _sourceOffsets.push_back(_sources.size());
+    _downstreamOffsets.push_back(_downstream.size());
+}
+
+void GraphSchedule::markNeeded(const std::vector<Node*>& sinks) {
+    _needed.assign(_order.size(), 0);
+    _stack.clear();
+
+    // Find the dirty nodes the sinks depend on.
+    // A clean node did not need its inputs the last time it was computed, so we stop walking there.
+    // Likewise for outputs that are still clean (see Node::_declareDependencies): reading them does not compute their node,
+    // neither through value() nor through Node::_inputsChanged, so a node left out here is not computed during the walk.
+    for (Node* sink : sinks) {
+        const auto& it = _positions.find(sink);
+        if (it == _positions.end()) continue;
+        _stack.push_back(it->second);
+    }
+    while (!_stack.empty()) {
+        size_t i = _stack.back();
+        _stack.pop_back();
+        if (_needed[i] || !_order[i]->isDirty()) continue;
+        _needed[i] = 1;
+        for (size_t j = _sourceOffsets[i]; j < _sourceOffsets[i + 1]; ++j) {
+            const Source& source = _sources[j];
+            if (source.socket->isOutput() && !source.socket->_isOutputDirty()) continue;
+            _stack.push_back(source.position);
+        }
+    }
+}
+
+void GraphSchedule::evaluate(const std::vector<Node*>& sinks) {
+    markNeeded(sinks);
+
+    // Everything upstream of a node comes before it, so its inputs are clean by the time it computes.
+    // Nodes that launch background work (see Node::launch) are not waited for, nodes reading from them are put off until the end,
+    // so the work overlaps with everything that does not depend on it.
+    _waiting.assign(_order.size(), 0);
+    _deferred.clear();
+    bool launched = false;
+    for (size_t i = 0; i < _order.size(); ++i) {
+        if (!_needed[i]) continue;
+        bool waits = false;
+        for (size_t j = _upstreamOffsets[i]; launched && j < _upstreamOffsets[i + 1] && !waits; ++j)
+            waits = _waiting[_upstream[j]] != 0;
+        if (waits) {
+            _waiting[i] = 1;
+            _deferred.push_back(i);
+        } else if (_order[i]->launch()) {
+            _waiting[i] = 1;
+            launched = true;
+        } else {
+            _order[i]->compute();
+        }
+    }
+    if (launched) {
+        // Still in order, so these only block on the background work they actually read from.
+        for (size_t i : _deferred)
+            if (!_order[i]->launch())
+                _order[i]->compute();
+        for (size_t i = 0; i < _order.size(); ++i)
+            if (_waiting[i])
+                _order[i]->compute();
+    }
+
+    // Nodes that were added after compiling fall back to pulling.
+    for (Node* sink : sinks)
+        if (!contains(*sink))
+            sink->compute();
+}
+
+void GraphSchedule::evaluateParallel(const std::vector<Node*>& sinks, ThreadPool& pool) {
+    markNeeded(sinks);
+
+    // Count for every needed node how many needed nodes it is still waiting for.
+    size_t count = 0;
+    std::unique_ptr<std::atomic<size_t>[]> waitingFor(new std::atomic<size_t>[_order.size()]);
+    for (size_t i = 0; i < _order.size(); ++i) {
+        if (!_needed[i]) continue;
+        ++count;
+        size_t n = 0;
+        for (size_t j = _upstreamOffsets[i]; j < _upstreamOffsets[i + 1]; ++j)
+            n += _needed[_upstream[j]];
+        waitingFor[i] = n;
+    }
+
+    if (count != 0) {
+        std::atomic<size_t> remaining = count;
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::deque<size_t> owningThreadQueue;
+        bool done = false;
+
+        std::function<void(size_t)> schedule;
+        auto run = [&](size_t i) {
+            _order[i]->compute();
+            for (size_t j = _downstreamOffsets[i]; j < _downstreamOffsets[i + 1]; ++j) {
+                size_t k = _downstream[j];
+                if (_needed[k] && --waitingFor[k] == 0)
+                    schedule(k);
+            }
+            if (--remaining == 0) {
+                // Notify under the lock, so the calling thread can not return (and destroy this state) before we are done with it.
+                std::lock_guard<std::mutex> lock(mutex);
+                done = true;
+                wake.notify_all();
+            }
+        };
+        schedule = [&](size_t i) {
+            // Nodes that launched background work wait for it on this thread, so they never tie up a worker
+            // (their work may well be queued on this same pool).
+            if (_order[i]->computeOnOwningThread() || _pullsExternal[i] || _order[i]->launch()) {
+                std::lock_guard<std::mutex> lock(mutex);
+                owningThreadQueue.push_back(i);
+                wake.notify_all();
+            } else {
+                pool.submit([&run, i]() { run(i); });
+            }
+        };
+
+        // Gather the initial set before scheduling anything, once nodes start running they will zero out other counters too.
+        _stack.clear();
+        for (size_t i = 0; i < _order.size(); ++i)
+            if (_needed[i] && waitingFor[i] == 0)
+                _stack.push_back(i);
+        for (size_t i : _stack)
+            schedule(i);
+
+        // Help out with the nodes that must run on this thread until everything is done.
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            wake.wait(lock, [&]() { return done || !owningThreadQueue.empty(); });
+            if (owningThreadQueue.empty())
+                break;
+            size_t i = owningThreadQueue.front();
+            owningThreadQueue.pop_front();
+            lock.unlock();
+            run(i);
+            lock.lock();
+        }
+    }
+
+    // Nodes that were added after compiling fall back to pulling.
+    for (Node* sink : sinks)
+        if (!contains(*sink))
+            sink->compute();
+}
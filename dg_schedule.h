@@ -0,0 +1,58 @@
+#pragma once
+
+#include "dg.h"
+#include "dg_threadpool.h"
+
+#include <unordered_map>
+
+// Flattens a set of nodes into a topologically sorted list, so evaluating a set of sinks
+// becomes a single forward walk instead of a recursive pull through Socket::value().
+// Each node computes after everything it depends on, so by the time it pulls its inputs they are already clean.
+// Nodes that were added after compile() are not part of the schedule and are simply pulled as before.
+class GraphSchedule {
+private:
+    // Nodes in evaluation order.
+    std::vector<Node*> _order;
+    // _upstream[_upstreamOffsets[i]] up to _upstream[_upstreamOffsets[i + 1]] are the positions in _order of the nodes feeding _order[i].
+    std::vector<size_t> _upstreamOffsets;
+    std::vector<size_t> _upstream;
+    // Same layout, listing the positions of the nodes that read from _order[i].
+    std::vector<size_t> _downstreamOffsets;
+    std::vector<size_t> _downstream;
+    // Same layout again, listing every socket _order[i] reads from and its node's position, so markNeeded can skip outputs that are still clean.
+    struct Source {
+        size_t position;
+        const ISocket* socket;
+    };
+    std::vector<size_t> _sourceOffsets;
+    std::vector<Source> _sources;
+    // Nodes that have inputs connected to nodes outside of the schedule; those pulls are not safe to do from multiple threads.
+    std::vector<char> _pullsExternal;
+    std::unordered_map<const Node*, size_t> _positions;
+
+    // Scratch buffers, kept around so evaluate() does not allocate in the steady state.
+    std::vector<char> _needed;
+    std::vector<size_t> _stack;
+    // Nodes with background work in flight, or reading from one, see evaluate.
+    std::vector<char> _waiting;
+    std::vector<size_t> _deferred;
+
+    static void gatherUpstream(const ISocket& socket, std::vector<const ISocket*>& result);
+    void markNeeded(const std::vector<Node*>& sinks);
+
+public:
+    // Sort the given nodes by the topological order they maintain while being connected, see Node::order.
+    void compile(const std::vector<Node*>& nodes);
+
+    // Compute all dirty nodes the given sinks depend on, in order, without recursion.
+    void evaluate(const std::vector<Node*>& sinks);
+
+    // Same as evaluate, but computes independent nodes concurrently on the given pool.
+    // A node runs as soon as all the nodes it reads from are done. Nodes that report computeOnOwningThread()
+    // are run on the calling thread, which blocks until everything is done. So are nodes that launch background work (see Node::launch),
+    // they wait for it there while the pool goes on with the rest.
+    void evaluateParallel(const std::vector<Node*>& sinks, ThreadPool& pool);
+
+    bool contains(const Node& node) const { return _positions.find(&node) != _positions.end(); }
+    const std::vector<Node*>& order() const { return _order; }
+};
@@ -0,0 +1,60 @@
+#include "dg_symbols.h"
+
+#include "../tt_cpplib/tt_messages.h"
+
+SymbolTable::SymbolTable() {
+    append("");
+}
+
+SymbolTable::~SymbolTable() {
+    for (auto& chunk : _chunks)
+        delete[] chunk.load(std::memory_order_relaxed);
+}
+
+SymbolTable& SymbolTable::instance() {
+    static SymbolTable table;
+    return table;
+}
+
+// Called with the mutex held.
+Symbol SymbolTable::append(const std::string& name) {
+    Symbol symbol = _size.load(std::memory_order_relaxed);
+    size_t chunkIndex = symbol / sChunkSize;
+    TT::assert(chunkIndex < sMaxChunks);
+    std::string* chunk = _chunks[chunkIndex].load(std::memory_order_relaxed);
+    if (!chunk) {
+        chunk = new std::string[sChunkSize];
+        _chunks[chunkIndex].store(chunk, std::memory_order_release);
+    }
+    std::string& stored = chunk[symbol % sChunkSize];
+    stored = name;
+    _ids[stored] = symbol;
+    // Publish the name before the symbol can be seen through _size.
+    _size.store(symbol + 1, std::memory_order_release);
+    return symbol;
+}
+
+Symbol SymbolTable::intern(const std::string& name) {
+    SymbolTable& table = instance();
+    std::lock_guard<std::mutex> lock(table._mutex);
+    auto it = table._ids.find(name);
+    if (it != table._ids.end())
+        return it->second;
+    return table.append(name);
+}
+
+bool SymbolTable::find(const std::string& name, Symbol& result) {
+    SymbolTable& table = instance();
+    std::lock_guard<std::mutex> lock(table._mutex);
+    auto it = table._ids.find(name);
+    if (it == table._ids.end())
+        return false;
+    result = it->second;
+    return true;
+}
+
+const std::string& SymbolTable::name(Symbol symbol) {
+    SymbolTable& table = instance();
+    TT::assert(symbol < table._size.load(std::memory_order_acquire));
+    return table._chunks[symbol / sChunkSize].load(std::memory_order_acquire)[symbol % sChunkSize];
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+typedef uint32_t Symbol;
+
+// Process wide table of interned strings, used for socket labels and node type names.
+// Every distinct string is stored once, and compares and hashes as a single integer.
+// Symbol 0 is always the empty string.
+// The table only ever grows, into chunks that never move, so name() does not need to lock.
+class SymbolTable {
+private:
+    static constexpr size_t sChunkSize = 4096;
+    static constexpr size_t sMaxChunks = 16384;
+
+    // Guards _ids and appending, not reading the names.
+    std::mutex _mutex;
+    // Views point into the chunks.
+    std::unordered_map<std::string_view, Symbol> _ids;
+    std::atomic<std::string*> _chunks[sMaxChunks] = {};
+    std::atomic<uint32_t> _size { 0 };
+
+    SymbolTable();
+    ~SymbolTable();
+    static SymbolTable& instance();
+    Symbol append(const std::string& name);
+
+public:
+    static Symbol intern(const std::string& name);
+    // Looks up a string without interning it, returns false if no one ever interned it.
+    static bool find(const std::string& name, Symbol& result);
+    static const std::string& name(Symbol symbol);
+};
@@ -0,0 +1,85 @@
+#include "dg_threadpool.h"
+
+namespace {
+    // Lets submit() find out whether it is called from one of our own workers.
+    thread_local const ThreadPool* tPool = nullptr;
+    thread_local size_t tWorkerIndex = 0;
+}
+
+ThreadPool::ThreadPool(size_t threadCount) {
+    if (threadCount == 0)
+        threadCount = std::thread::hardware_concurrency();
+    if (threadCount == 0)
+        threadCount = 1;
+    for (size_t i = 0; i < threadCount; ++i)
+        _workers.push_back(std::make_unique<Worker>());
+    for (size_t i = 0; i < threadCount; ++i)
+        _threads.emplace_back([this, i]() { run(i); });
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(_sleepMutex);
+        _stopping = true;
+    }
+    _wake.notify_all();
+    for (auto& thread : _threads)
+        thread.join();
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    size_t index = tPool == this ? tWorkerIndex : _nextWorker++ % _workers.size();
+    {
+        // Counting under the sleep mutex makes sure a worker that is about to sleep sees the new task.
+        // Count before pushing, so a worker that takes the task right away can not decrement first and wrap around.
+        std::lock_guard<std::mutex> lock(_sleepMutex);
+        ++_queued;
+    }
+    {
+        std::lock_guard<std::mutex> lock(_workers[index]->mutex);
+        _workers[index]->tasks.push_back(std::move(task));
+    }
+    _wake.notify_one();
+}
+
+bool ThreadPool::pop(size_t index, std::function<void()>& task) {
+    Worker& worker = *_workers[index];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    if (worker.tasks.empty())
+        return false;
+    task = std::move(worker.tasks.back());
+    worker.tasks.pop_back();
+    --_queued;
+    return true;
+}
+
+bool ThreadPool::steal(size_t index, std::function<void()>& task) {
+    for (size_t offset = 1; offset < _workers.size(); ++offset) {
+        Worker& victim = *_workers[(index + offset) % _workers.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (victim.tasks.empty())
+            continue;
+        task = std::move(victim.tasks.front());
+        victim.tasks.pop_front();
+        --_queued;
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::run(size_t index) {
+    tPool = this;
+    tWorkerIndex = index;
+    std::function<void()> task;
+    while (true) {
+        if (pop(index, task) || steal(index, task)) {
+            task();
+            task = nullptr;
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(_sleepMutex);
+        _wake.wait(lock, [this]() { return _stopping || _queued > 0; });
+        if (_stopping && _queued == 0)
+            return;
+    }
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A small work-stealing thread pool.
+// Every worker owns a queue. Tasks submitted from a worker go to the back of its own queue and are taken from the back (depth first, warm caches),
+// idle workers steal from the front of the other queues. Tasks submitted from any other thread are spread over the workers round-robin.
+class ThreadPool {
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::unique_ptr<Worker>> _workers;
+    std::vector<std::thread> _threads;
+    std::atomic<size_t> _nextWorker = 0;
+
+    std::mutex _sleepMutex;
+    std::condition_variable _wake;
+    std::atomic<size_t> _queued = 0;
+    bool _stopping = false;
+
+    bool pop(size_t index, std::function<void()>& task);
+    bool steal(size_t index, std::function<void()>& task);
+    void run(size_t index);
+
+public:
+    // 0 threads means one per hardware thread.
+    explicit ThreadPool(size_t threadCount = 0);
+    ~ThreadPool();
+
+    void submit(std::function<void()> task);
+    size_t size() const { return _threads.size(); }
+
+    ThreadPool(const ThreadPool& rhs) = delete;
+    ThreadPool(ThreadPool&& rhs) = delete;
+    ThreadPool& operator=(const ThreadPool& rhs) = delete;
+    ThreadPool& operator=(ThreadPool&& rhs) = delete;
+};
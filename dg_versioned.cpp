@@ -0,0 +1,115 @@
+#include "dg_versioned.h"
+
+#include <algorithm>
+#include <thread>
+
+EpochReclaimer::Guard::~Guard() {
+    if (!_reclaimer) return;
+    Slot& slot = _reclaimer->_slots[_slot];
+    slot.epoch.store(0, std::memory_order_release);
+    slot.used.store(false, std::memory_order_release);
+}
+
+EpochReclaimer::~EpochReclaimer() {
+    for (const Retired& retired : _retired)
+        retired.destroy(retired.pointer);
+}
+
+EpochReclaimer::Guard EpochReclaimer::pin() {
+    // Every thread tends to find the same slot, so after the first pin this is one successful exchange.
+    thread_local size_t tHint = 0;
+    for (size_t attempt = 0;; ++attempt) {
+        size_t index = (tHint + attempt) % sMaxReaders;
+        Slot& slot = _slots[index];
+        bool expected = false;
+        if (slot.used.load(std::memory_order_relaxed) || !slot.used.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+            // Every slot is taken, give the guards holding them a chance to finish.
+            if (attempt % sMaxReaders == sMaxReaders - 1)
+                std::this_thread::yield();
+            continue;
+        }
+        // Sequentially consistent, so a collect either sees this epoch or we see every pointer swapped before it.
+        slot.epoch.store(_epoch.load());
+        tHint = index;
+        return Guard(*this, index);
+    }
+}
+
+void EpochReclaimer::_retire(void* pointer, void (*destroy)(void*)) {
+    std::lock_guard<std::mutex> lock(_retiredMutex);
+    _retired.push_back({ _epoch.load(), pointer, destroy });
+}
+
+size_t EpochReclaimer::collect() {
+    uint64_t oldest = _epoch.fetch_add(1) + 1;
+    for (const Slot& slot : _slots) {
+        uint64_t epoch = slot.epoch.load();
+        if (epoch != 0 && epoch < oldest)
+            oldest = epoch;
+    }
+
+    // Guards pinned at the retire epoch or later may have loaded the pointer before it was replaced.
+    std::vector<Retired> freed;
+    {
+        std::lock_guard<std::mutex> lock(_retiredMutex);
+        size_t kept = 0;
+        for (const Retired& retired : _retired) {
+            if (retired.epoch < oldest)
+                freed.push_back(retired);
+            else
+                _retired[kept++] = retired;
+        }
+        _retired.resize(kept);
+    }
+    for (const Retired& retired : freed)
+        retired.destroy(retired.pointer);
+    return freed.size();
+}
+
+size_t EpochReclaimer::retiredCount() {
+    std::lock_guard<std::mutex> lock(_retiredMutex);
+    return _retired.size();
+}
+
+GraphEditQueue::~GraphEditQueue() {
+    for (Published* published : _pending)
+        delete published;
+    Published* published = _head.exchange(nullptr);
+    while (published) {
+        Published* next = published->next;
+        delete published;
+        published = next;
+    }
+}
+
+uint64_t GraphEditQueue::publish(Batch&& batch) {
+    uint64_t version = ++_publishedVersion;
+    Published* published = new Published { std::move(batch), version, _head.load(std::memory_order_relaxed) };
+    // Once pushed, apply may run and delete it at any moment.
+    // Publishers racing each other may push in a different order than they got their versions, apply sorts that out.
+    while (!_head.compare_exchange_weak(published->next, published, std::memory_order_release, std::memory_order_relaxed));
+    return version;
+}
+
+bool GraphEditQueue::apply() {
+    Published* published = _head.exchange(nullptr, std::memory_order_acquire);
+    if (!published && _pending.empty()) return false;
+
+    // Newest first, usually. A publisher may also still be pushing a version older than what we got,
+    // so batches are applied in version order, and those after a gap wait for the next apply.
+    for (; published; published = published->next)
+        _pending.push_back(published);
+    std::sort(_pending.begin(), _pending.end(), [](const Published* a, const Published* b) { return a->version < b->version; });
+
+    size_t applied = 0;
+    for (; applied < _pending.size() && _pending[applied]->version == _appliedVersion + 1; ++applied) {
+        Published* batch = _pending[applied];
+        for (const Edit& edit : batch->batch._edits)
+            if (!edit())
+                ++_rejected;
+        _appliedVersion = batch->version;
+        delete batch;
+    }
+    _pending.erase(_pending.begin(), _pending.begin() + applied);
+    return applied != 0;
+}
@@ -0,0 +1,177 @@
+#pragma once
+
+#include "dg.h"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+// Epoch based reclamation: readers pin the current epoch while they hold on to shared data,
+// writers retire the data they replaced, and collect() frees what was retired before the oldest pinned epoch.
+// Pinning is a store to a per reader slot, readers never wait on writers or on each other.
+class EpochReclaimer {
+public:
+    static constexpr size_t sMaxReaders = 64;
+
+    // Keeps everything that was current when it was made alive until it goes out of scope.
+    class Guard {
+    private:
+        EpochReclaimer* _reclaimer;
+        size_t _slot;
+        friend class EpochReclaimer;
+
+        Guard(EpochReclaimer& reclaimer, size_t slot) : _reclaimer(&reclaimer), _slot(slot) {}
+
+    public:
+        ~Guard();
+        Guard(Guard&& rhs) : _reclaimer(rhs._reclaimer), _slot(rhs._slot) { rhs._reclaimer = nullptr; }
+        Guard(const Guard& rhs) = delete;
+        Guard& operator=(const Guard& rhs) = delete;
+        Guard& operator=(Guard&& rhs) = delete;
+    };
+
+private:
+    struct alignas(64) Slot {
+        std::atomic<bool> used { false };
+        // 0 while not pinned.
+        std::atomic<uint64_t> epoch { 0 };
+    };
+
+    struct Retired {
+        uint64_t epoch;
+        void* pointer;
+        void (*destroy)(void*);
+    };
+
+    std::atomic<uint64_t> _epoch { 1 };
+    Slot _slots[sMaxReaders];
+    std::mutex _retiredMutex;
+    std::vector<Retired> _retired;
+
+    void _retire(void* pointer, void (*destroy)(void*));
+
+public:
+    EpochReclaimer() = default;
+    // Frees everything still retired, no guards may be alive.
+    ~EpochReclaimer();
+
+    // With more than sMaxReaders guards alive at once, this waits for one to go away.
+    Guard pin();
+    // Deletes pointer once no guard made before this call is alive anymore.
+    template<typename T> void retire(const T* pointer) { _retire((void*)pointer, [](void* p) { delete (T*)p; }); }
+    // Moves to the next epoch and frees what no guard can see anymore. Returns the number of pointers freed.
+    size_t collect();
+    size_t retiredCount();
+
+    EpochReclaimer(const EpochReclaimer& rhs) = delete;
+    EpochReclaimer& operator=(const EpochReclaimer& rhs) = delete;
+};
+
+// A value that one thread publishes and others read without locking.
+// Every publish makes a new immutable version, readers keep seeing the version they loaded for as long as their guard lives.
+template<typename T> class Versioned {
+private:
+    struct Version {
+        T value;
+        uint64_t number;
+    };
+
+    EpochReclaimer& _reclaimer;
+    std::atomic<const Version*> _current;
+
+public:
+    Versioned(EpochReclaimer& reclaimer, const T& initialValue = T())
+        : _reclaimer(reclaimer), _current(new Version { initialValue, 0 }) {}
+    ~Versioned() { delete _current.load(); }
+
+    // The latest version, valid until guard goes out of scope.
+    const T& read(const EpochReclaimer::Guard& guard) const { return _current.load(std::memory_order_acquire)->value; }
+    // Its number. Also needs a guard, as the version holding it may be collected as soon as another one is published.
+    uint64_t version(const EpochReclaimer::Guard& guard) const { return _current.load(std::memory_order_acquire)->number; }
+
+    // Returns the number of the new version. Publishing from several threads is allowed, the last one wins.
+    uint64_t publish(const T& value) {
+        const Version* next = new Version { value, 0 };
+        const Version* previous = _current.load(std::memory_order_relaxed);
+        do {
+            const_cast<Version*>(next)->number = previous->number + 1;
+        } while (!_current.compare_exchange_weak(previous, next, std::memory_order_acq_rel, std::memory_order_relaxed));
+        _reclaimer.retire(previous);
+        return next->number;
+    }
+
+    Versioned(const Versioned& rhs) = delete;
+    Versioned& operator=(const Versioned& rhs) = delete;
+};
+
+// Lets an editor thread change a graph that another thread evaluates.
+// The graph is only ever touched by the evaluating thread: the editor records its edits in a Batch and publishes it,
+// and the evaluating thread applies everything published so far in between evaluations (CompiledFrame::update does so first thing).
+// Every evaluation therefore sees the graph as of one version, and a batch is either applied as a whole or not yet at all.
+// Publishing is a push onto a lock free list and applying swaps the whole list out, so neither side waits for the other.
+// Results the editor wants to read back can be published by the evaluating thread through a Versioned.
+class GraphEditQueue {
+public:
+    // Returns false if the graph refused the edit.
+    typedef std::function<bool()> Edit;
+
+    // Edits to publish together. Sockets are captured by pointer, so removing nodes has to be an edit as well.
+    class Batch {
+    private:
+        std::vector<Edit> _edits;
+        friend class GraphEditQueue;
+
+    public:
+        void edit(Edit edit) { _edits.push_back(std::move(edit)); }
+        template<typename SocketT> void setValue(SocketT& socket, const typename SocketT::value_t& value) {
+            _edits.push_back([&socket, value]() { socket.setValue(value); return true; });
+        }
+        // A connection that would create a cycle is refused when applied, see rejectedCount.
+        template<typename SocketT> void setInput(SocketT& socket, SocketT& input);
+        template<typename SocketT> void disconnect(SocketT& socket) {
+            _edits.push_back([&socket]() { socket.disconnect(); return true; });
+        }
+        bool empty() const { return _edits.empty(); }
+        size_t size() const { return _edits.size(); }
+    };
+
+private:
+    struct Published {
+        Batch batch;
+        uint64_t version;
+        Published* next;
+    };
+
+    std::atomic<Published*> _head { nullptr };
+    std::atomic<uint64_t> _publishedVersion { 0 };
+    std::atomic<uint64_t> _appliedVersion { 0 };
+    std::atomic<size_t> _rejected { 0 };
+    // Batches taken off the list that wait for an older one that is still being published. Only touched by apply.
+    std::vector<Published*> _pending;
+
+public:
+    GraphEditQueue() = default;
+    // Drops edits that were never applied.
+    ~GraphEditQueue();
+
+    // Called by the editor, from any thread. Batches are applied in the order of the versions they get.
+    // Returns the version the graph is at once the batch is applied.
+    uint64_t publish(Batch&& batch);
+    // Called by the thread that evaluates the graph. Applies the published batches in version order,
+    // returns false if there were none. A batch whose predecessor is still being published waits for the next call.
+    bool apply();
+
+    uint64_t publishedVersion() const { return _publishedVersion; }
+    // The version of the last applied batch, results computed after apply() reflect the edits up to here.
+    uint64_t appliedVersion() const { return _appliedVersion; }
+    size_t rejectedCount() const { return _rejected; }
+
+    GraphEditQueue(const GraphEditQueue& rhs) = delete;
+    GraphEditQueue& operator=(const GraphEditQueue& rhs) = delete;
+};
+
+template<typename SocketT> void GraphEditQueue::Batch::setInput(SocketT& socket, SocketT& input) {
+    _edits.push_back([&socket, &input]() { return socket.setInput(input); });
+}
@@ -1,5 +1,7 @@
 #include "rendering_nodes.h"
+#include "rendering_frame.h"
 #include "dg_io.h"
+#include "dg_schedule.h"
 
 #include "../tt_cpplib/windont.h"
 #include "../tt_cpplib/tt_window.h"
@@ -7,33 +9,48 @@
 #include "../tt_cpplib/tt_strings.h"
 #include "../tt_rendering/gl/tt_glcontext.h"
 
-#include <unordered_set>
-
 struct RenderGraph {
+    // Owns all nodes and their sockets.
+    GraphArena arena;
     std::vector<Node*> nodes;
-    // We can probably just compute all nodes instead of tracking only specific node types or nodes without outputs.
-    std::vector<Node*> sinkNodes;
-    std::vector<CreateRenderPassNode*> renderPassNodes;
+    // The passes whose result we want, usually the one presenting to the window. Passes and nodes these do not depend on are never evaluated.
+    // When empty, every pass that draws to the window is an output.
+    std::vector<CreateRenderPassNode*> outputs;
+    // Images that scale with the window are connected to this.
+    ResolutionNode* resolution = nullptr;
 
     template<typename T> T& instantiate(const std::string& label) {
-        nodes.push_back(new T(label));
-        if constexpr (std::is_same_v<T, MaterialSetImageNode> || std::is_same_v<T, DrawQuadNode>)
-            sinkNodes.push_back((T*)nodes.back());
-        if constexpr (std::is_same_v<T, CreateRenderPassNode>)
-            renderPassNodes.push_back((T*)nodes.back());
-        return *(T*)nodes.back();
+        T& node = arena.create<T>(label);
+        adopt(node);
+        return node;
+    }
+
+    // Tracks a node that was created in our arena, e.g. by the GraphSerializer.
+    void adopt(Node& node) {
+        nodes.push_back(&node);
+        if (ResolutionNode* resolutionNode = dynamic_cast<ResolutionNode*>(&node))
+            resolution = resolutionNode;
     }
 
-    void destroy() { for (Node* node : nodes) delete node; }
+    void destroy() { 
+        nodes.clear();
+        outputs.clear();
+        resolution = nullptr;
+        arena.clear();
+    }
 };
 
-RenderGraph generateTestGraph() {
-    RenderGraph graph;
+// Builds in place, as the nodes point back at the arena they were created in.
+void generateTestGraph(RenderGraph& graph) {
+
+    auto& resolution = graph.instantiate<ResolutionNode>("resolution");
 
     auto& cbo = graph.instantiate<CreateImageNode>("cbo");
     cbo.width.setValue(0);
     cbo.height.setValue(0);
     cbo.factor.setValue(1);
+    cbo.resolutionWidth.setInput(resolution.width);
+    cbo.resolutionHeight.setInput(resolution.height);
 
     auto& fbo = graph.instantiate<CreateFramebufferNode>("fbo");
     fbo.colorBuffers.appendNew().setInput(cbo.result);
@@ -68,7 +85,7 @@ RenderGraph generateTestGraph() {
     presentPass.material.setInput(blit.result);
     presentPass.renderPass.setInput(present.result);
 
-    return graph;
+    graph.outputs.push_back(&present);
 }
 
 #if 0
@@ -138,62 +155,39 @@ int main() {
     f.rhs.setInput(e.result);
     TT::assert(f.result.value() == 720.0f);
 
-    generateTestGraph();
+    RenderGraph graph;
+    generateTestGraph(graph);
+    graph.destroy();
 
     return (int)f.result.value();
 }
 #endif
 
-// TODO: Make handles hashable and use unordered_set
-template<typename T> class HandleSet {
-    std::vector<size_t> identifiers;
-    std::vector<T> contents;
-
-    size_t index(size_t identifier) const {
-        const auto& it = std::find(identifiers.begin(), identifiers.end(), identifier);
-        if (it == identifiers.end()) return identifiers.size();
-        return it - identifiers.begin();
-    }
-
-public:
-    void insert(const T& t, size_t identifier) {
-        size_t i = index(identifier);
-        if (i == identifiers.size()) {
-            contents.push_back(t);
-            identifiers.push_back(identifier);
-        }
-    }
-
-    bool contains(const T& t, size_t identifier) {
-        return index(t, identifier) != contents.size();
-    }
-
-    auto begin() const { return contents.begin(); }
-    auto end() const { return contents.end(); }
-};
-
 class App : public TT::Window {
     TTRendering::OpenGLContext context;
+    ForwardingRenderGraphContext graphContext;
     TTRendering::MeshHandle quadMesh = TTRendering::MeshHandle::Null;
     bool sizeKnown = false;
+    // Reads shader files in the background while the window comes up, for contexts that compile shader source.
+    ThreadPool ioPool { 4 };
+    ShaderSourceCache shaderSources { ioPool };
     RenderGraph graph;
-    std::vector<const TTRendering::RenderPass*> orderedRenderPasses;
+    CompiledFrame frame;
 
 public:
-    App() : TT::Window(), context(*this) {
+    App() : TT::Window(), context(*this), graphContext(context) {
         show();
     }
 
     virtual ~App() {
-        for (const TTRendering::RenderPass* renderPass : orderedRenderPasses) 
-            delete renderPass;
+        // The nodes own the passes and release their images and framebuffers.
         graph.destroy();
     }
 
     void initRenderingResources() {   
 #if 1
         // Obtain a graph that describes the rendering pipeline
-        graph = generateTestGraph();
+        generateTestGraph(graph);
 #endif
 
 #if 0
@@ -210,34 +204,12 @@ public:
             // Get an empty vassal
             // graph.destroy();
             // graph.nodes.clear();
-            // graph.sinkNodes.clear();
-            // graph.renderPassNodes.clear();
+            // graph.outputs.clear();
 
-            // Set up the deserializer factory
+            // The rendering node and socket types register themselves, see rendering_nodes.cpp
             GraphSerializer deserializer;
-            deserializer.nodeFactory["CreateImageNode"] = [&](const std::string& label) -> Node& { return graph.instantiate<CreateImageNode>(label); };
-            deserializer.nodeFactory["CreateFramebufferNode"] = [&](const std::string& label) -> Node& { return graph.instantiate<CreateFramebufferNode>(label); };
-            deserializer.nodeFactory["CreateRenderPassNode"] = [&](const std::string& label) -> Node& { return graph.instantiate<CreateRenderPassNode>(label); };
-            deserializer.nodeFactory["DrawQuadNode"] = [&](const std::string& label) -> Node& { return graph.instantiate<DrawQuadNode>(label); };
-            deserializer.nodeFactory["CreateMaterialNode"] = [&](const std::string& label) -> Node& { return graph.instantiate<CreateMaterialNode>(label); };
-            deserializer.nodeFactory["MaterialSetImageNode"] = [&](const std::string& label) -> Node& { return graph.instantiate<MaterialSetImageNode>(label); };
-            
-            // TODO: Duplicating the default values here is a real problem. Maybe we should remove that being an argument and solve it some other way.
-            deserializer.socketFactory["Vec4"] = [&](const std::string& label, bool isOutput, Node& node) -> ISocket* { return new Vec4Socket(label, TT::Vec4(0.0f, 0.0f, 0.0f, 0.0f), isOutput, node); };
-            deserializer.socketFactory["String"] = [&](const std::string& label, bool isOutput, Node& node) -> ISocket* { return new StringSocket(label, "", isOutput, node); };
-            
-            deserializer.socketFactory["F32"] = [&](const std::string& label, bool isOutput, Node& node) -> ISocket* { return new F32Socket(label, 0.0f, isOutput, node); };
-            deserializer.socketFactory["U16"] = [&](const std::string& label, bool isOutput, Node& node) -> ISocket* { return new U16Socket(label, 0, isOutput, node); };
-            deserializer.socketFactory["ImageFormat"] = [&](const std::string& label, bool isOutput, Node& node) -> ISocket* { return new ImageFormatSocket(label, TTRendering::ImageFormat::RGBA32F, isOutput, node); };
-            deserializer.socketFactory["ImageInterpolation"] = [&](const std::string& label, bool isOutput, Node& node) -> ISocket* { return new ImageInterpolationSocket(label, TTRendering::ImageInterpolation::Linear, isOutput, node); };
-            deserializer.socketFactory["ImageTiling"] = [&](const std::string& label, bool isOutput, Node& node) -> ISocket* { return new ImageTilingSocket(label, TTRendering::ImageTiling::Clamp, isOutput, node); };
-            deserializer.socketFactory["MaterialBlendMode"] = [&](const std::string& label, bool isOutput, Node& node) -> ISocket* { return new MaterialBlendModeSocket(label, TTRendering::MaterialBlendMode::Opaque, isOutput, node); };
-
-            deserializer.socketFactory["ImageHandle"] = [&](const std::string& label, bool isOutput, Node& node) -> ISocket* { return new ImageHandleSocket(label, TTRendering::ImageHandle::Null, isOutput, node); };
-            deserializer.socketFactory["FramebufferHandle"] = [&](const std::string& label, bool isOutput, Node& node) -> ISocket* { return new FramebufferHandleSocket(label, TTRendering::FramebufferHandle::Null, isOutput, node); };
-            deserializer.socketFactory["MaterialHandle"] = [&](const std::string& label, bool isOutput, Node& node) -> ISocket* { return new MaterialHandleSocket(label, TTRendering::MaterialHandle::Null, isOutput, node); };
-            deserializer.socketFactory["RenderPass"] = [&](const std::string& label, bool isOutput, Node& node) -> ISocket* { return new RenderPassSocket(label, nullptr, isOutput, node); };
-                
+            deserializer.arena = &graph.arena;
+
             // Load the file
             std::ifstream in("testGraph.json");
             TTJson::Parser parser;
@@ -247,7 +219,9 @@ public:
                 TT::warning(parser.error());
             } else {
                 // Deserialize into the graph
-                deserializer.deserializeGraph(obj);
+                for (Node* node : deserializer.deserializeGraph(obj))
+                    if (node)
+                        graph.adopt(*node);
 
                 if(deserializer.deserializeErrors.size() > 0) {
                     auto errors = TT::join(deserializer.deserializeErrors, "\n");
@@ -258,73 +232,45 @@ public:
 #endif
 
         // Make sure the rendering nodes are ready to evaluate graphs
-        RenderGraphGlobals::gContext = &context;
+        RenderGraphGlobals::gContext = &graphContext;
 
         float quadVerts[] = { 0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 1.0f, 0.0f, 1.0f };
         TTRendering::BufferHandle quadVbo = context.createBuffer(sizeof(float) * 8, (unsigned char*)quadVerts);
         quadMesh = context.createMesh(4, quadVbo, { {TTRendering::MeshAttribute::Dimensions::D2, TTRendering::MeshAttribute::ElementType::F32, 0} }, nullptr, TTRendering::PrimitiveType::TriangleFan);
         RenderGraphGlobals::gQuadMesh = &quadMesh;
 
-        // Then make sure all endpoints are evaluated to generate the actual GPU pipeline
-        for(const auto& node : graph.sinkNodes)
-            node->compute();
-        
-        // Gather the passes that were generated
-        std::vector<TTRendering::RenderPass*> renderPasses;
-        for (const auto& node : graph.renderPassNodes)
-            renderPasses.push_back(node->result.value());
-
-        // Find which passes are responsible for generating which images
-        std::map</*ImageHandle*/size_t, std::set<TTRendering::RenderPass*>> imageGenerators = {};
-        for(const auto& renderPass : renderPasses) {
-            const auto& fbo = renderPass->framebuffer();
-            if (!fbo) continue;
-            for (const auto& cbo : fbo->colorAttachments())
-                imageGenerators[cbo.identifier()].insert(renderPass);
-            const auto& dbo = fbo->depthStencilAttachment();
-            if(dbo)
-                imageGenerators[dbo->identifier()].insert(renderPass);
+        // Graphs saved before ResolutionNode existed read the resolution from the context, give them one so resizes are seen.
+        if (!graph.resolution)
+            graph.instantiate<ResolutionNode>("resolution");
+        graph.resolution->connectScaledImages(graph.nodes);
+        unsigned int width, height;
+        context.resolution(width, height);
+        graph.resolution->setResolution(width, height);
+
+        // The frame orders the passes with RenderPassScheduler: every pass comes after the passes that draw the images it samples.
+        // Ordering by image handle would no longer work here, as images that share memory (see TransientImagePlanner) share their handle.
+        // Passes the outputs do not depend on are culled, so nothing that only feeds them is allocated or drawn.
+        // The GPU pipeline itself is generated on the first update.
+        frame.setGraph(graph.nodes, graph.outputs);
+
+        // The GL context compiles stages from their files, reading them ahead of time would only read every file twice.
+        if (graphContext.compilesShaderSource()) {
+            RenderGraphGlobals::gShaderSources = &shaderSources;
+            shaderSources.request(graph.nodes);
         }
+    }
 
-        // In turn, sort the passes based on which images they use,
-        // and thus after which passes they have to go.
-        for(const TTRendering::RenderPass* renderPass : renderPasses) {
-            // This pass needs these images
-            std::unordered_set<TTRendering::MaterialHandle> mtls;
-            HandleSet<TTRendering::ImageHandle> imgs;
-            for(const auto& q : renderPass->drawQueue().queues)
-                for(const auto& q2 : q.queues)
-                    for(const auto& q2e : q2.keys)
-                        mtls.insert(q2e);
-            for (const auto& mtl : mtls) {
-                const auto& mtlImages = mtl.images();
-                for(const auto& img : mtlImages) {
-                    size_t sz = img.second;
-                    const auto& ref = mtlImages.handle(sz);
-                    imgs.insert(ref, ref.identifier());
-                }
-            }
-
-            // and thus it comes after the passes that generate these images
-            size_t insertAt = 0;
-            for(const auto& img : imgs) {
-                const auto& it = imageGenerators.find(img.identifier());
-                if(it != imageGenerators.end()) {
-                    for(const auto& previous : it->second) {
-                        const auto& it2 = std::find(orderedRenderPasses.begin(), orderedRenderPasses.end(), previous);
-                        if(it2 != orderedRenderPasses.end()) {
-                            size_t alternative = it2 - orderedRenderPasses.begin() + 1;
-                            if(alternative > insertAt)
-                                insertAt = alternative;
-                        }
-                    }
-                }
-            }
-            if (insertAt == orderedRenderPasses.size())
-                orderedRenderPasses.push_back(renderPass);
-            else
-                orderedRenderPasses.insert(orderedRenderPasses.begin() + insertAt, renderPass);
-        }
+    void updateFrame() {
+        // Materials are computed once all their shader sources are read, until then we keep drawing what we have.
+        if (!shaderSources.ready())
+            return;
+        if (!frame.update())
+            return;
+        std::vector<std::string> hazards;
+        for (const RenderPassScheduler::Hazard& hazard : frame.scheduler().hazards())
+            hazards.push_back(hazard.reader->label() + " samples " + hazard.image->label() + " before " + hazard.writer->label() + " draws it");
+        if (hazards.size() > 0)
+            TT::warning(TT::join(hazards, "\n"));
     }
 
 private:
@@ -334,12 +280,18 @@ private:
         if (!sizeKnown) { 
             sizeKnown = true;
             initRenderingResources();
+            return;
         }
+
+        // Only the images that scale with the window, and what uses them, recompute on the next update.
+        graph.resolution->setResolution(event.width, event.height);
     }
 
     void onPaintEvent(const TT::PaintEvent& event) override {
+        // Costs nothing unless the graph was edited since the last frame.
+        updateFrame();
         context.beginFrame();
-        for (const TTRendering::RenderPass* renderPass : orderedRenderPasses)
+        for (const TTRendering::RenderPass* renderPass : frame.passes())
             context.drawPass(*renderPass);
         context.endFrame();
     }
@@ -0,0 +1,107 @@
+#include "rendering_aliasing.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+
+bool TransientImagePlanner::compatible(CreateImageNode& a, CreateImageNode& b) {
+    return a.width.value() == b.width.value() && a.height.value() == b.height.value() && a.factor.value() == b.factor.value() &&
+        a.format.value() == b.format.value() && a.interpolation.value() == b.interpolation.value() && a.tiling.value() == b.tiling.value();
+}
+
+bool TransientImagePlanner::aliasesCompatible() const {
+    for (const auto& alias : _aliases)
+        if (!compatible(*alias.first, *alias.second))
+            return false;
+    return true;
+}
+
+void TransientImagePlanner::plan(const std::vector<Node*>& nodes) {
+    _scheduler.schedule(nodes);
+    _planScheduled();
+}
+
+void TransientImagePlanner::plan(const std::vector<Node*>& nodes, const std::vector<CreateRenderPassNode*>& outputs) {
+    _scheduler.schedule(nodes);
+    _scheduler.cull(outputs);
+    _planScheduled();
+}
+
+void TransientImagePlanner::_planScheduled() {
+    _lifetimes.clear();
+    _aliases.clear();
+
+    std::unordered_map<const CreateImageNode*, size_t> lifetimeIndices;
+    std::vector<size_t> firstWrite;
+    std::vector<size_t> firstRead;
+    auto touch = [&](CreateImageNode* image, size_t position, bool write) {
+        auto it = lifetimeIndices.find(image);
+        if (it == lifetimeIndices.end()) {
+            it = lifetimeIndices.emplace(image, _lifetimes.size()).first;
+            _lifetimes.push_back({ image, position, position, false });
+            firstWrite.push_back(SIZE_MAX);
+            firstRead.push_back(SIZE_MAX);
+        }
+        Lifetime& lifetime = _lifetimes[it->second];
+        lifetime.first = std::min(lifetime.first, position);
+        lifetime.last = std::max(lifetime.last, position);
+        size_t& first = write ? firstWrite[it->second] : firstRead[it->second];
+        first = std::min(first, position);
+    };
+    for (size_t position = 0; position < _scheduler.passes().size(); ++position) {
+        for (CreateImageNode* image : _scheduler.writes(position))
+            touch(image, position, true);
+        for (CreateImageNode* image : _scheduler.reads(position))
+            touch(image, position, false);
+    }
+    for (size_t i = 0; i < _lifetimes.size(); ++i)
+        _lifetimes[i].transient = firstWrite[i] != SIZE_MAX && (firstRead[i] == SIZE_MAX || firstRead[i] > firstWrite[i]);
+
+    // Greedily hand every transient image the first compatible allocation that is free by the time it is first used.
+    struct Allocation {
+        CreateImageNode* owner;
+        size_t last;
+    };
+    std::vector<const Lifetime*> transients;
+    for (const Lifetime& lifetime : _lifetimes)
+        if (lifetime.transient)
+            transients.push_back(&lifetime);
+    std::stable_sort(transients.begin(), transients.end(), [](const Lifetime* a, const Lifetime* b) { return a->first < b->first; });
+    std::vector<Allocation> allocations;
+    for (const Lifetime* lifetime : transients) {
+        Allocation* found = nullptr;
+        for (Allocation& allocation : allocations) {
+            if (allocation.last < lifetime->first && compatible(*allocation.owner, *lifetime->image)) {
+                found = &allocation;
+                break;
+            }
+        }
+        if (found) {
+            _aliases.push_back({ lifetime->image, found->owner });
+            found->last = lifetime->last;
+        } else {
+            allocations.push_back({ lifetime->image, lifetime->last });
+        }
+    }
+}
+
+size_t TransientImagePlanner::apply() {
+    // Connections that are already right are left alone, so applying the same plan again does not dirty anything.
+    std::unordered_map<const CreateImageNode*, CreateImageNode*> targets;
+    for (const auto& alias : _aliases)
+        targets[alias.first] = alias.second;
+    size_t count = 0;
+    for (const Lifetime& lifetime : _lifetimes) {
+        const auto& it = targets.find(lifetime.image);
+        ImageHandleSocket& input = lifetime.image->alias;
+        if (it == targets.end()) {
+            input.disconnect();
+            continue;
+        }
+        if (input.input() != &it->second->result)
+            input.disconnect();
+        if (input.setInput(it->second->result))
+            count++;
+    }
+    return count;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "rendering_passes.h"
+
+// Lifetime analysis for the images of a pipeline graph, so intermediate images that are never in use at the same time can share memory.
+// Works on the graph itself, before anything is allocated: passes draw to the images of their framebuffer,
+// and sample the images set on the materials drawn into them.
+class TransientImagePlanner {
+public:
+    struct Lifetime {
+        CreateImageNode* image;
+        // Positions in passes() of the first and last pass that draws to or samples the image.
+        size_t first;
+        size_t last;
+        // Only images that are drawn to before they are sampled can share memory, others must keep their contents between frames.
+        bool transient;
+    };
+
+private:
+    RenderPassScheduler _scheduler;
+    std::vector<Lifetime> _lifetimes;
+    // Pairs of (image, image whose memory it uses).
+    std::vector<std::pair<CreateImageNode*, CreateImageNode*>> _aliases;
+
+    void _planScheduled();
+
+public:
+    // Orders the passes with RenderPassScheduler, determines in which passes each image is in use, and pairs up images that can share memory.
+    void plan(const std::vector<Node*>& nodes);
+    // Same, for only the passes that outputs depend on, see RenderPassScheduler::cull.
+    void plan(const std::vector<Node*>& nodes, const std::vector<CreateRenderPassNode*>& outputs);
+    // Connects the alias input of every image that can share memory, and disconnects it on the others.
+    // Returns the number of images that no longer allocate.
+    size_t apply();
+
+    // Whether the images of every planned pair still have the same size and format. They are values, so editing them does not change the topology.
+    bool aliasesCompatible() const;
+    // Whether two images can share memory.
+    static bool compatible(CreateImageNode& a, CreateImageNode& b);
+
+    const RenderPassScheduler& scheduler() const { return _scheduler; }
+    const std::vector<CreateRenderPassNode*>& passes() const { return _scheduler.passes(); }
+    const std::vector<Lifetime>& lifetimes() const { return _lifetimes; }
+    const std::vector<std::pair<CreateImageNode*, CreateImageNode*>>& aliases() const { return _aliases; }
+};
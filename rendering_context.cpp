@@ -0,0 +1,178 @@
+#include "rendering_context.h"
+#include "dg_json_stream.h"
+#include "../tt_cpplib/tt_messages.h"
+
+#include <algorithm>
+
+namespace {
+    // The recorded resources do not exist anywhere, their handles just carry an identifier that is unique within this context.
+    template<typename HandleT> HandleT makeHandle(size_t identifier) { return HandleT(identifier); }
+}
+
+RecordingRenderGraphContext::RecordingRenderGraphContext(unsigned int width, unsigned int height)
+    : _width(width), _height(height) {
+    // Every format TTRendering can allocate, so image bytes are what the GPU would hold (before any padding it adds).
+    _bytesPerPixel[TTRendering::ImageFormat::R8] = 1;
+    _bytesPerPixel[TTRendering::ImageFormat::RG8] = 2;
+    _bytesPerPixel[TTRendering::ImageFormat::RGB8] = 3;
+    _bytesPerPixel[TTRendering::ImageFormat::RGBA8] = 4;
+    _bytesPerPixel[TTRendering::ImageFormat::R16F] = 2;
+    _bytesPerPixel[TTRendering::ImageFormat::RG16F] = 4;
+    _bytesPerPixel[TTRendering::ImageFormat::RGB16F] = 6;
+    _bytesPerPixel[TTRendering::ImageFormat::RGBA16F] = 8;
+    _bytesPerPixel[TTRendering::ImageFormat::R32F] = 4;
+    _bytesPerPixel[TTRendering::ImageFormat::RG32F] = 8;
+    _bytesPerPixel[TTRendering::ImageFormat::RGB32F] = 12;
+    _bytesPerPixel[TTRendering::ImageFormat::RGBA32F] = 16;
+    _bytesPerPixel[TTRendering::ImageFormat::Depth32F] = 4;
+    _bytesPerPixel[TTRendering::ImageFormat::Depth24Stencil8] = 4;
+}
+
+void RecordingRenderGraphContext::resolution(unsigned int& width, unsigned int& height) {
+    _calls["resolution"]++;
+    width = _width;
+    height = _height;
+}
+
+TTRendering::ImageHandle RecordingRenderGraphContext::createImage(unsigned int width, unsigned int height, TTRendering::ImageFormat format, TTRendering::ImageInterpolation interpolation, TTRendering::ImageTiling tiling) {
+    _calls["createImage"]++;
+    size_t identifier = _nextIdentifier++;
+    _images.push_back({ identifier, width, height, format, (size_t)width * height * bytesPerPixel(format), false });
+    _liveImageBytes += _images.back().bytes;
+    _peakImageBytes = std::max(_peakImageBytes, _liveImageBytes);
+    return makeHandle<TTRendering::ImageHandle>(identifier);
+}
+
+TTRendering::FramebufferHandle RecordingRenderGraphContext::createFramebuffer(const std::vector<TTRendering::ImageHandle>& colorBuffers, const TTRendering::ImageHandle* depthBuffer) {
+    _calls["createFramebuffer"]++;
+    FramebufferRecord record { _nextIdentifier++, {}, depthBuffer ? depthBuffer->identifier() : 0, false };
+    for (const auto& colorBuffer : colorBuffers)
+        record.colorBuffers.push_back(colorBuffer.identifier());
+    _framebuffers.push_back(record);
+    return makeHandle<TTRendering::FramebufferHandle>(record.identifier);
+}
+
+TTRendering::ShaderStageHandle RecordingRenderGraphContext::fetchShaderStage(const char* path) {
+    _calls["fetchShaderStage"]++;
+    auto it = _shaderStages.find(path);
+    if (it == _shaderStages.end())
+        it = _shaderStages.emplace(path, makeHandle<TTRendering::ShaderStageHandle>(_nextIdentifier++)).first;
+    return it->second;
+}
+
+TTRendering::ShaderStageHandle RecordingRenderGraphContext::fetchShaderStage(const char* path, const std::string& source) {
+    _calls["fetchShaderStageSource"]++;
+    auto it = _shaderStages.find(path);
+    if (it == _shaderStages.end())
+        it = _shaderStages.emplace(path, makeHandle<TTRendering::ShaderStageHandle>(_nextIdentifier++)).first;
+    return it->second;
+}
+
+TTRendering::ShaderHandle RecordingRenderGraphContext::fetchShader(const std::vector<TTRendering::ShaderStageHandle>& stages) {
+    _calls["fetchShader"]++;
+    _shaders++;
+    return makeHandle<TTRendering::ShaderHandle>(_nextIdentifier++);
+}
+
+TTRendering::MaterialHandle RecordingRenderGraphContext::createMaterial(const TTRendering::ShaderHandle& shader, TTRendering::MaterialBlendMode blendMode) {
+    _calls["createMaterial"]++;
+    _materials++;
+    return makeHandle<TTRendering::MaterialHandle>(_nextIdentifier++);
+}
+
+void RecordingRenderGraphContext::releaseImage(const TTRendering::ImageHandle& image) {
+    _calls["releaseImage"]++;
+    for (ImageRecord& record : _images) {
+        if (record.identifier != image.identifier() || record.released) continue;
+        record.released = true;
+        _liveImageBytes -= record.bytes;
+        return;
+    }
+    _unknownReleases++;
+}
+
+void RecordingRenderGraphContext::releaseFramebuffer(const TTRendering::FramebufferHandle& framebuffer) {
+    _calls["releaseFramebuffer"]++;
+    for (FramebufferRecord& record : _framebuffers) {
+        if (record.identifier != framebuffer.identifier() || record.released) continue;
+        record.released = true;
+        return;
+    }
+    _unknownReleases++;
+}
+
+void RecordingRenderGraphContext::reset() {
+    _nextIdentifier = 1;
+    _images.clear();
+    _framebuffers.clear();
+    _shaderStages.clear();
+    _shaders = 0;
+    _materials = 0;
+    _calls.clear();
+    _liveImageBytes = 0;
+    _peakImageBytes = 0;
+    _unknownReleases = 0;
+}
+
+size_t RecordingRenderGraphContext::bytesPerPixel(TTRendering::ImageFormat format) const {
+    auto it = _bytesPerPixel.find(format);
+    // A format that is missing from the table would make every report wrong, add it in the constructor.
+    TT::assert(it != _bytesPerPixel.end());
+    return it == _bytesPerPixel.end() ? 0 : it->second;
+}
+
+size_t RecordingRenderGraphContext::imageBytes() const {
+    size_t bytes = 0;
+    for (const ImageRecord& image : _images)
+        bytes += image.bytes;
+    return bytes;
+}
+
+void RecordingRenderGraphContext::writeReport(JsonWriter& writer) const {
+    writer.beginObject();
+    writer.key("images");
+    writer.value((long long)_images.size());
+    writer.key("imageBytes");
+    writer.value((long long)imageBytes());
+    writer.key("liveImageBytes");
+    writer.value((long long)_liveImageBytes);
+    writer.key("peakImageBytes");
+    writer.value((long long)_peakImageBytes);
+    writer.key("framebuffers");
+    writer.value((long long)_framebuffers.size());
+    writer.key("shaderStages");
+    writer.value((long long)_shaderStages.size());
+    writer.key("shaders");
+    writer.value((long long)_shaders);
+    writer.key("materials");
+    writer.value((long long)_materials);
+    writer.key("unknownReleases");
+    writer.value((long long)_unknownReleases);
+    writer.key("calls");
+    writer.beginObject();
+    for (const auto& call : _calls) {
+        writer.key(call.first);
+        writer.value((long long)call.second);
+    }
+    writer.endObject();
+    writer.key("imageList");
+    writer.beginArray();
+    for (const ImageRecord& image : _images) {
+        writer.beginObject();
+        writer.key("id");
+        writer.value((long long)image.identifier);
+        writer.key("width");
+        writer.value((long long)image.width);
+        writer.key("height");
+        writer.value((long long)image.height);
+        writer.key("format");
+        writer.value((long long)image.format);
+        writer.key("bytes");
+        writer.value((long long)image.bytes);
+        writer.key("released");
+        writer.value(image.released);
+        writer.endObject();
+    }
+    writer.endArray();
+    writer.endObject();
+}
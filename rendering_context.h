@@ -0,0 +1,136 @@
+#pragma once
+
+#include "../tt_rendering/tt_rendering.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+class JsonWriter;
+
+// What the rendering nodes need from a rendering backend, see RenderGraphGlobals::gContext.
+// Keeping this small lets us run pipeline graphs against something other than a GPU.
+class RenderGraphContext {
+public:
+    virtual ~RenderGraphContext() = default;
+
+    virtual void resolution(unsigned int& width, unsigned int& height) = 0;
+    virtual TTRendering::ImageHandle createImage(unsigned int width, unsigned int height, TTRendering::ImageFormat format, TTRendering::ImageInterpolation interpolation, TTRendering::ImageTiling tiling) = 0;
+    // depthBuffer may be null.
+    virtual TTRendering::FramebufferHandle createFramebuffer(const std::vector<TTRendering::ImageHandle>& colorBuffers, const TTRendering::ImageHandle* depthBuffer) = 0;
+    virtual TTRendering::ShaderStageHandle fetchShaderStage(const char* path) = 0;
+    // Whether fetchShaderStage(path, source) compiles the given text. Otherwise it reads path like the overload above,
+    // and reading the file ahead of time (see ShaderSourceCache) would only read it twice.
+    virtual bool compilesShaderSource() const { return false; }
+    // Same as fetchShaderStage(path), from the contents of path that were already read. path still identifies the stage.
+    virtual TTRendering::ShaderStageHandle fetchShaderStage(const char* path, const std::string& source) { return fetchShaderStage(path); }
+    virtual TTRendering::ShaderHandle fetchShader(const std::vector<TTRendering::ShaderStageHandle>& stages) = 0;
+    virtual TTRendering::MaterialHandle createMaterial(const TTRendering::ShaderHandle& shader, TTRendering::MaterialBlendMode blendMode) = 0;
+    // Frees what createImage / createFramebuffer returned, the handle must not be used afterwards.
+    virtual void releaseImage(const TTRendering::ImageHandle& image) = 0;
+    virtual void releaseFramebuffer(const TTRendering::FramebufferHandle& framebuffer) = 0;
+};
+
+// Forwards to a real rendering context, e.g. the OpenGLContext of the application.
+class ForwardingRenderGraphContext final : public RenderGraphContext {
+private:
+    TTRendering::RenderingContext& _context;
+
+public:
+    explicit ForwardingRenderGraphContext(TTRendering::RenderingContext& context) : _context(context) {}
+
+    void resolution(unsigned int& width, unsigned int& height) override { _context.resolution(width, height); }
+    TTRendering::ImageHandle createImage(unsigned int width, unsigned int height, TTRendering::ImageFormat format, TTRendering::ImageInterpolation interpolation, TTRendering::ImageTiling tiling) override {
+        return _context.createImage(width, height, format, interpolation, tiling);
+    }
+    TTRendering::FramebufferHandle createFramebuffer(const std::vector<TTRendering::ImageHandle>& colorBuffers, const TTRendering::ImageHandle* depthBuffer) override {
+        return depthBuffer ? _context.createFramebuffer(colorBuffers, depthBuffer) : _context.createFramebuffer(colorBuffers);
+    }
+    // TTRendering compiles stages from their files, so this keeps the default fetchShaderStage(path, source).
+    TTRendering::ShaderStageHandle fetchShaderStage(const char* path) override { return _context.fetchShaderStage(path); }
+    TTRendering::ShaderHandle fetchShader(const std::vector<TTRendering::ShaderStageHandle>& stages) override { return _context.fetchShader(stages); }
+    TTRendering::MaterialHandle createMaterial(const TTRendering::ShaderHandle& shader, TTRendering::MaterialBlendMode blendMode) override { return _context.createMaterial(shader, blendMode); }
+    void releaseImage(const TTRendering::ImageHandle& image) override { _context.deleteImage(image); }
+    void releaseFramebuffer(const TTRendering::FramebufferHandle& framebuffer) override { _context.deleteFramebuffer(framebuffer); }
+};
+
+// Stand-in for headless runs: hands out handles without touching a GPU and records every resource that would have been created,
+// so the setup cost, resource counts and memory of a pipeline can be measured (and checked) on any machine.
+class RecordingRenderGraphContext final : public RenderGraphContext {
+public:
+    struct ImageRecord {
+        size_t identifier;
+        unsigned int width;
+        unsigned int height;
+        TTRendering::ImageFormat format;
+        size_t bytes;
+        bool released;
+    };
+
+    struct FramebufferRecord {
+        size_t identifier;
+        std::vector<size_t> colorBuffers;
+        // 0 if there is none.
+        size_t depthBuffer;
+        bool released;
+    };
+
+private:
+    unsigned int _width;
+    unsigned int _height;
+    // Handle identifiers, 0 is left for the Null handles.
+    size_t _nextIdentifier = 1;
+    std::vector<ImageRecord> _images;
+    std::vector<FramebufferRecord> _framebuffers;
+    // Shader stages are fetched by path, so like a real context we only count each path once.
+    std::map<std::string, TTRendering::ShaderStageHandle> _shaderStages;
+    size_t _shaders = 0;
+    size_t _materials = 0;
+    std::map<std::string, size_t> _calls;
+    std::map<TTRendering::ImageFormat, size_t> _bytesPerPixel;
+    size_t _liveImageBytes = 0;
+    size_t _peakImageBytes = 0;
+    // Releases of handles we never created, or released already.
+    size_t _unknownReleases = 0;
+
+public:
+    // The resolution reported to nodes that size their images relative to the window.
+    RecordingRenderGraphContext(unsigned int width = 1920, unsigned int height = 1080);
+
+    void resolution(unsigned int& width, unsigned int& height) override;
+    TTRendering::ImageHandle createImage(unsigned int width, unsigned int height, TTRendering::ImageFormat format, TTRendering::ImageInterpolation interpolation, TTRendering::ImageTiling tiling) override;
+    TTRendering::FramebufferHandle createFramebuffer(const std::vector<TTRendering::ImageHandle>& colorBuffers, const TTRendering::ImageHandle* depthBuffer) override;
+    TTRendering::ShaderStageHandle fetchShaderStage(const char* path) override;
+    bool compilesShaderSource() const override { return true; }
+    TTRendering::ShaderStageHandle fetchShaderStage(const char* path, const std::string& source) override;
+    TTRendering::ShaderHandle fetchShader(const std::vector<TTRendering::ShaderStageHandle>& stages) override;
+    TTRendering::MaterialHandle createMaterial(const TTRendering::ShaderHandle& shader, TTRendering::MaterialBlendMode blendMode) override;
+    void releaseImage(const TTRendering::ImageHandle& image) override;
+    void releaseFramebuffer(const TTRendering::FramebufferHandle& framebuffer) override;
+
+    void setResolution(unsigned int width, unsigned int height) { _width = width; _height = height; }
+    // Forgets everything that was recorded.
+    void reset();
+
+    // Every image and framebuffer ever created, including the released ones.
+    const std::vector<ImageRecord>& images() const { return _images; }
+    const std::vector<FramebufferRecord>& framebuffers() const { return _framebuffers; }
+    size_t shaderStageCount() const { return _shaderStages.size(); }
+    size_t shaderCount() const { return _shaders; }
+    size_t materialCount() const { return _materials; }
+    // Number of calls per method name, including the ones that did not create anything new.
+    const std::map<std::string, size_t>& calls() const { return _calls; }
+    // Bytes of every image ever created, of the images not released yet, and the most that were alive at once.
+    size_t imageBytes() const;
+    size_t liveImageBytes() const { return _liveImageBytes; }
+    size_t peakImageBytes() const { return _peakImageBytes; }
+    // Releases of images or framebuffers that were not created here, or were released already. Those are bugs in the nodes.
+    size_t unknownReleases() const { return _unknownReleases; }
+
+    // Writes the counts, image bytes and every image as a json object.
+    void writeReport(JsonWriter& writer) const;
+
+    // Used to count image bytes. Every format has its size filled in, this overrides it, e.g. for a backend that pads RGB to RGBA.
+    void setBytesPerPixel(TTRendering::ImageFormat format, size_t bytes) { _bytesPerPixel[format] = bytes; }
+    size_t bytesPerPixel(TTRendering::ImageFormat format) const;
+};
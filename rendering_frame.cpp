@@ -0,0 +1,147 @@
+#include "rendering_frame.h"
+
+#include <algorithm>
+
+namespace {
+    // Follows the connections of an input back to the output that provides its value, null if there is none.
+    template<typename SocketT> const ISocket* origin(const SocketT& socket) {
+        const SocketT* current = &socket;
+        while (current->input())
+            current = current->input();
+        return current->isOutput() ? current : nullptr;
+    }
+
+    template<typename SocketT> void appendEdge(std::vector<std::pair<const ISocket*, const ISocket*>>& edges, const SocketT& socket) {
+        edges.emplace_back(&socket, origin(socket));
+    }
+}
+
+void CompiledFrame::setGraph(const std::vector<Node*>& nodes, const std::vector<CreateRenderPassNode*>& outputs) {
+    _nodes = nodes;
+    _outputs = outputs;
+    _stale = true;
+
+    _arenas.clear();
+    _unowned = false;
+    _passNodes.clear();
+    for (Node* node : _nodes) {
+        if (!node->arena())
+            _unowned = true;
+        else if (std::find_if(_arenas.begin(), _arenas.end(), [node](const auto& arena) { return arena.first == node->arena(); }) == _arenas.end())
+            _arenas.emplace_back(node->arena(), 0);
+        if (dynamic_cast<CreateRenderPassNode*>(node) || dynamic_cast<CreateFramebufferNode*>(node) ||
+            dynamic_cast<DrawQuadNode*>(node) || dynamic_cast<MaterialSetImageNode*>(node))
+            _passNodes.push_back(node);
+    }
+}
+
+bool CompiledFrame::update() {
+    if (_edits)
+        _edits->apply();
+    bool topologyChanged = _stale || _topologyChanged();
+    bool rebuild = _stale;
+    // Most connections do not change which images the passes exchange, those only need the evaluation order updated.
+    if (!rebuild && topologyChanged) {
+        _gatherPassEdges(_currentPassEdges);
+        rebuild = _currentPassEdges != _passEdges;
+    }
+    // An aliased image ignores its own settings, so when they change it has to be planned again.
+    if (!rebuild && aliasImages && Node::revision() != _revision && !_planner.aliasesCompatible())
+        rebuild = true;
+    if (rebuild)
+        _rebuild();
+    else if (topologyChanged)
+        _schedule.compile(_nodes);
+    if (rebuild || Node::revision() != _revision)
+        _evaluate();
+    // Read these last, as rebuilding and evaluating change them too.
+    _recordTopology();
+    _revision = Node::revision();
+    return rebuild;
+}
+
+bool CompiledFrame::_topologyChanged() const {
+    if (_unowned && Node::topologyRevision() != _topologyRevision)
+        return true;
+    for (const auto& arena : _arenas)
+        if (arena.first->topologyRevision() != arena.second)
+            return true;
+    return false;
+}
+
+void CompiledFrame::_recordTopology() {
+    _topologyRevision = Node::topologyRevision();
+    for (auto& arena : _arenas)
+        arena.second = arena.first->topologyRevision();
+}
+
+void CompiledFrame::_gatherPassEdges(std::vector<std::pair<const ISocket*, const ISocket*>>& edges) const {
+    // The same connections RenderPassScheduler::schedule follows.
+    edges.clear();
+    for (Node* node : _passNodes) {
+        if (CreateRenderPassNode* pass = dynamic_cast<CreateRenderPassNode*>(node)) {
+            appendEdge(edges, pass->framebuffer);
+        } else if (CreateFramebufferNode* framebuffer = dynamic_cast<CreateFramebufferNode*>(node)) {
+            for (const ImageHandleSocket* colorBuffer : framebuffer->colorBuffers.children())
+                appendEdge(edges, *colorBuffer);
+            appendEdge(edges, framebuffer->depthBuffer);
+        } else if (DrawQuadNode* draw = dynamic_cast<DrawQuadNode*>(node)) {
+            appendEdge(edges, draw->renderPass);
+            appendEdge(edges, draw->material);
+        } else if (MaterialSetImageNode* setImage = dynamic_cast<MaterialSetImageNode*>(node)) {
+            appendEdge(edges, setImage->material);
+            appendEdge(edges, setImage->image);
+        }
+    }
+}
+
+void CompiledFrame::_rebuild() {
+    _planner.plan(_nodes, _outputs.empty() ? RenderPassScheduler::presentedPasses(_nodes) : _outputs);
+    if (aliasImages)
+        _planner.apply();
+    _schedule.compile(_nodes);
+
+    // Passes whose set of draws is the same as before keep their queue, the others start over.
+    const RenderPassScheduler& scheduler = _planner.scheduler();
+    std::unordered_map<CreateRenderPassNode*, std::vector<DrawQuadNode*>> previous;
+    previous.swap(_draws);
+    for (size_t position = 0; position < scheduler.passes().size(); ++position) {
+        CreateRenderPassNode* pass = scheduler.passes()[position];
+        std::vector<DrawQuadNode*>& draws = _draws[pass];
+        for (Node* node : scheduler.draws(position))
+            if (DrawQuadNode* draw = dynamic_cast<DrawQuadNode*>(node))
+                draws.push_back(draw);
+        const auto& it = previous.find(pass);
+        if (it == previous.end() || it->second != draws)
+            pass->resetDrawQueue();
+    }
+
+    _gatherPassEdges(_passEdges);
+    _stale = false;
+    _rebuilds++;
+}
+
+void CompiledFrame::_evaluate() {
+    const RenderPassScheduler& scheduler = _planner.scheduler();
+    _schedule.evaluate(scheduler.sinks());
+
+    // A draw that computed again added to a queue that still held its earlier draw, those passes start over.
+    // That dirties all their draws, which then queue once into the new pass.
+    bool requeue = false;
+    for (CreateRenderPassNode* pass : scheduler.passes()) {
+        for (DrawQuadNode* draw : _draws[pass]) {
+            if (draw->queuedTwice()) {
+                pass->resetDrawQueue();
+                requeue = true;
+                break;
+            }
+        }
+    }
+    if (requeue)
+        _schedule.evaluate(scheduler.sinks());
+
+    _passes.clear();
+    for (CreateRenderPassNode* pass : scheduler.passes())
+        _passes.push_back(pass->result.value());
+    _evaluations++;
+}
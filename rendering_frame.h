@@ -0,0 +1,63 @@
+#pragma once
+
+#include "rendering_aliasing.h"
+#include "dg_schedule.h"
+#include "dg_versioned.h"
+
+// Everything needed to draw a pipeline graph every frame: the passes to draw in order, and what to evaluate to keep them up to date.
+// update() compares the graph revisions it was built at (see Node::revision and GraphArena::topologyRevision), so a frame in which nothing changed costs a few loads.
+// Value changes only recompute the nodes they dirtied. Connection changes in the graph update the evaluation order,
+// the passes are only scheduled again when a connection that decides which images they exchange changed.
+class CompiledFrame {
+private:
+    std::vector<Node*> _nodes;
+    std::vector<CreateRenderPassNode*> _outputs;
+    TransientImagePlanner _planner;
+    GraphSchedule _schedule;
+    GraphEditQueue* _edits = nullptr;
+    // The draws into every scheduled pass as of the last rebuild, so a rebuild only empties the queues whose draws changed.
+    std::unordered_map<CreateRenderPassNode*, std::vector<DrawQuadNode*>> _draws;
+    std::vector<const TTRendering::RenderPass*> _passes;
+    bool _stale = true;
+    uint64_t _revision = 0;
+    // The arenas the nodes live in, with their topology revisions as of the last update.
+    // Nodes that are not in an arena are only covered by the process wide Node::topologyRevision.
+    std::vector<std::pair<const GraphArena*, uint64_t>> _arenas;
+    bool _unowned = false;
+    uint64_t _topologyRevision = 0;
+    // The passes, framebuffers, draws and nodes setting images on materials, whose connections decide the pass order.
+    // Along with where each of those connections led at the last rebuild, as (socket, output it reads from) pairs.
+    std::vector<Node*> _passNodes;
+    std::vector<std::pair<const ISocket*, const ISocket*>> _passEdges;
+    std::vector<std::pair<const ISocket*, const ISocket*>> _currentPassEdges;
+    size_t _rebuilds = 0;
+    size_t _evaluations = 0;
+
+    void _rebuild();
+    void _evaluate();
+    bool _topologyChanged() const;
+    void _recordTopology();
+    void _gatherPassEdges(std::vector<std::pair<const ISocket*, const ISocket*>>& edges) const;
+
+public:
+    // Let transient images share memory, see TransientImagePlanner. Takes effect on the next rebuild.
+    bool aliasImages = true;
+
+    // The nodes of the graph, and the passes whose result we want. Without outputs, the passes that draw to the window are used.
+    void setGraph(const std::vector<Node*>& nodes, const std::vector<CreateRenderPassNode*>& outputs = {});
+    // Edits published from other threads are applied at the start of every update, so the graph stays put while it is evaluated.
+    void setEditQueue(GraphEditQueue* edits) { _edits = edits; }
+    // Forces the next update to schedule the passes again.
+    void invalidate() { _stale = true; }
+
+    // Brings the passes up to date with the graph. Returns true if they were scheduled again, e.g. to report new hazards.
+    // Edits to graphs in other arenas do not cost anything here.
+    bool update();
+
+    // The passes to draw, in order. Valid until the next update.
+    const std::vector<const TTRendering::RenderPass*>& passes() const { return _passes; }
+    const RenderPassScheduler& scheduler() const { return _planner.scheduler(); }
+    const TransientImagePlanner& planner() const { return _planner; }
+    size_t rebuildCount() const { return _rebuilds; }
+    size_t evaluationCount() const { return _evaluations; }
+};
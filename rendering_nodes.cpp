@@ -1,8 +1,41 @@
 #include "rendering_nodes.h"
+#include "dg_registry.h"
 
 namespace RenderGraphGlobals {
-    TTRendering::RenderingContext* gContext;
+    RenderGraphContext* gContext;
     TTRendering::MeshHandle* gQuadMesh;
+    ShaderSourceCache* gShaderSources;
+}
+
+ResolutionNode::ResolutionNode(const std::string& label)
+    : Node(label)
+    , windowWidth(addInput<U16Socket>("windowWidth", 0))
+    , windowHeight(addInput<U16Socket>("windowHeight", 0))
+    , width(addOutput<U16Socket>("width", 0))
+    , height(addOutput<U16Socket>("height", 0)) {
+    _initializing = false;
+}
+
+void ResolutionNode::setResolution(unsigned int width, unsigned int height) {
+    windowWidth.setValue((unsigned short)width);
+    windowHeight.setValue((unsigned short)height);
+}
+
+size_t ResolutionNode::connectScaledImages(const std::vector<Node*>& nodes) {
+    size_t count = 0;
+    for (Node* node : nodes) {
+        CreateImageNode* image = dynamic_cast<CreateImageNode*>(node);
+        if (!image || !image->factor.value() || image->resolutionWidth.input() || image->resolutionHeight.input())
+            continue;
+        if (image->resolutionWidth.setInput(width) && image->resolutionHeight.setInput(height))
+            count++;
+    }
+    return count;
+}
+
+void ResolutionNode::_compute() {
+    width.setValue(windowWidth.value());
+    height.setValue(windowHeight.value());
 }
 
 CreateImageNode::CreateImageNode(const std::string& label)
@@ -13,18 +46,52 @@ CreateImageNode::CreateImageNode(const std::string& label)
     , interpolation(addInput<ImageInterpolationSocket>("interpolation", TTRendering::ImageInterpolation::Linear))
     , tiling(addInput<ImageTilingSocket>("tiling", TTRendering::ImageTiling::Clamp))
     , factor(addInput<U16Socket>("factor", 0))
+    , resolutionWidth(addInput<U16Socket>("resolutionWidth", 0))
+    , resolutionHeight(addInput<U16Socket>("resolutionHeight", 0))
+    , alias(addInput<ImageHandleSocket>("alias", TTRendering::ImageHandle::Null))
     , result(addOutput<ImageHandleSocket>("result", TTRendering::ImageHandle::Null)) {
     _initializing = false;
 }
 
+CreateImageNode::~CreateImageNode() {
+    _release();
+}
+
+void CreateImageNode::_release() {
+    if (_image != TTRendering::ImageHandle::Null && RenderGraphGlobals::gContext)
+        RenderGraphGlobals::gContext->releaseImage(_image);
+    _image = TTRendering::ImageHandle::Null;
+}
+
 void CreateImageNode::_compute() {
-    // Create new image with given settings.
-    unsigned int w, h;
-    RenderGraphGlobals::gContext->resolution(w, h);
+    const auto& shared = alias.value();
+    if (shared != TTRendering::ImageHandle::Null) {
+        _release();
+        result.setValue(shared);
+        return;
+    }
+
+    unsigned int w = 0, h = 0;
     unsigned short f = factor.value();
+    if (f) {
+        if (resolutionWidth.input() && resolutionHeight.input()) {
+            w = resolutionWidth.value();
+            h = resolutionHeight.value();
+        } else {
+            RenderGraphGlobals::gContext->resolution(w, h);
+        }
+    }
     w = width.value() + (f ? (w / f) : 0);
     h = height.value() + (f ? (h / f) : 0);
-    result.setValue(RenderGraphGlobals::gContext->createImage(w, h, format.value(), interpolation.value(), tiling.value()));
+    Settings settings { w, h, format.value(), interpolation.value(), tiling.value() };
+
+    // Create new image with given settings, unless we already have one.
+    if (_image == TTRendering::ImageHandle::Null || !(settings == _settings)) {
+        _release();
+        _image = RenderGraphGlobals::gContext->createImage(w, h, settings.format, settings.interpolation, settings.tiling);
+        _settings = settings;
+    }
+    result.setValue(_image);
 }
 
 CreateFramebufferNode::CreateFramebufferNode(const std::string& label)
@@ -35,6 +102,16 @@ CreateFramebufferNode::CreateFramebufferNode(const std::string& label)
     _initializing = false;
 }
 
+CreateFramebufferNode::~CreateFramebufferNode() {
+    _release();
+}
+
+void CreateFramebufferNode::_release() {
+    if (_framebuffer != TTRendering::FramebufferHandle::Null && RenderGraphGlobals::gContext)
+        RenderGraphGlobals::gContext->releaseFramebuffer(_framebuffer);
+    _framebuffer = TTRendering::FramebufferHandle::Null;
+}
+
 void CreateFramebufferNode::_compute() {
     std::vector<TTRendering::ImageHandle> cbos;
     for(const auto& child : colorBuffers.children()) {
@@ -42,14 +119,22 @@ void CreateFramebufferNode::_compute() {
         if (cbo != TTRendering::ImageHandle::Null)
             cbos.push_back(cbo);
     }
-
     const auto& dbo = depthBuffer.value();
+
+    // Keep the framebuffer we have if it is still attached to the same images.
+    if (_framebuffer != TTRendering::FramebufferHandle::Null && cbos == _colorBuffers && dbo == _depthBuffer) {
+        result.setValue(_framebuffer);
+        return;
+    }
+
+    _release();
     if (dbo != TTRendering::ImageHandle::Null)
-        result.setValue(RenderGraphGlobals::gContext->createFramebuffer(cbos, &dbo));
+        _framebuffer = RenderGraphGlobals::gContext->createFramebuffer(cbos, &dbo);
     else if(cbos.size() > 0)
-        result.setValue(RenderGraphGlobals::gContext->createFramebuffer(cbos));
-    else
-        result.setValue(TTRendering::FramebufferHandle::Null);
+        _framebuffer = RenderGraphGlobals::gContext->createFramebuffer(cbos, nullptr);
+    _colorBuffers.swap(cbos);
+    _depthBuffer = dbo;
+    result.setValue(_framebuffer);
 }
 
 CreateMaterialNode::CreateMaterialNode(const std::string& label)
@@ -62,9 +147,21 @@ CreateMaterialNode::CreateMaterialNode(const std::string& label)
 
 void CreateMaterialNode::_compute() {
     std::vector<TTRendering::ShaderStageHandle> stages;
-    for(const auto& shaderPath : shaderPaths.children())
-        stages.push_back(RenderGraphGlobals::gContext->fetchShaderStage(shaderPath->value().data()));
-    result.setValue(RenderGraphGlobals::gContext->createMaterial(RenderGraphGlobals::gContext->fetchShader(stages), blendMode.value()));
+    RenderGraphContext& context = *RenderGraphGlobals::gContext;
+    // Only take the sources read in the background if the context compiles them, else it would read the files again.
+    ShaderSourceCache* sources = context.compilesShaderSource() ? RenderGraphGlobals::gShaderSources : nullptr;
+    for(const auto& shaderPath : shaderPaths.children()) {
+        // Files with the same contents are fetched as one stage. Unreadable files are passed on as is, so the context reports them.
+        if (sources) {
+            const ShaderSourceCache::Source& source = sources->wait(shaderPath->value());
+            if (source.loaded) {
+                stages.push_back(context.fetchShaderStage(source.canonicalPath.data(), source.text));
+                continue;
+            }
+        }
+        stages.push_back(context.fetchShaderStage(shaderPath->value().data()));
+    }
+    result.setValue(context.createMaterial(context.fetchShader(stages), blendMode.value()));
 }
 
 MaterialSetImageNode::MaterialSetImageNode(const std::string& label)
@@ -92,15 +189,25 @@ CreateRenderPassNode::CreateRenderPassNode(const std::string& label)
     _initializing = false;
 }
 
+void CreateRenderPassNode::resetDrawQueue() {
+    if (!_renderPass) return;
+    // Allocate the new pass before freeing the old one, so the draws can tell them apart.
+    std::unique_ptr<TTRendering::RenderPass> renderPass = std::make_unique<TTRendering::RenderPass>();
+    _renderPass.swap(renderPass);
+    dirty(clearColor);
+}
+
 void CreateRenderPassNode::_compute() {
-    TTRendering::RenderPass* renderPass = new TTRendering::RenderPass;
-    renderPass->clearColor = clearColor.value();
+    // The pass is updated in place, so the draw nodes connected to it do not have to queue their draws again.
+    if (!_renderPass)
+        _renderPass = std::make_unique<TTRendering::RenderPass>();
+    _renderPass->clearColor = clearColor.value();
     const auto& fbo = framebuffer.value();
     if(fbo == TTRendering::FramebufferHandle::Null)
-        renderPass->clearFramebuffer();
+        _renderPass->clearFramebuffer();
     else
-        renderPass->setFramebuffer(framebuffer.value());
-    result.setValue(renderPass);
+        _renderPass->setFramebuffer(framebuffer.value());
+    result.setValue(_renderPass.get());
 }
 
 DrawQuadNode::DrawQuadNode(const std::string& label)
@@ -112,8 +219,33 @@ DrawQuadNode::DrawQuadNode(const std::string& label)
 
 void DrawQuadNode::_compute() {
     auto& renderPass_ = renderPass.value();
+    _queuedTwice = _queuedInto && _queuedInto == renderPass_;
+    _queuedInto = nullptr;
     if (!renderPass_) return;
     const auto& mtl = material.value();
     if (mtl == TTRendering::MaterialHandle::Null) return;
     renderPass_->addToDrawQueue(*RenderGraphGlobals::gQuadMesh, mtl);
+    _queuedInto = renderPass_;
 }
+
+// Make the types above loadable by GraphSerializer.
+TT_DG_REGISTER_SOCKET(Vec4Socket, TT::Vec4(0.0f, 0.0f, 0.0f, 0.0f))
+TT_DG_REGISTER_SOCKET(StringSocket, "")
+TT_DG_REGISTER_SOCKET(F32Socket, 0.0f)
+TT_DG_REGISTER_SOCKET(U16Socket, 0)
+TT_DG_REGISTER_SOCKET(ImageFormatSocket, TTRendering::ImageFormat::RGBA32F)
+TT_DG_REGISTER_SOCKET(ImageInterpolationSocket, TTRendering::ImageInterpolation::Linear)
+TT_DG_REGISTER_SOCKET(ImageTilingSocket, TTRendering::ImageTiling::Clamp)
+TT_DG_REGISTER_SOCKET(MaterialBlendModeSocket, TTRendering::MaterialBlendMode::Opaque)
+TT_DG_REGISTER_SOCKET(ImageHandleSocket, TTRendering::ImageHandle::Null)
+TT_DG_REGISTER_SOCKET(FramebufferHandleSocket, TTRendering::FramebufferHandle::Null)
+TT_DG_REGISTER_SOCKET(MaterialHandleSocket, TTRendering::MaterialHandle::Null)
+TT_DG_REGISTER_SOCKET(RenderPassSocket, nullptr)
+
+TT_DG_REGISTER_NODE(ResolutionNode)
+TT_DG_REGISTER_NODE(CreateImageNode)
+TT_DG_REGISTER_NODE(CreateFramebufferNode)
+TT_DG_REGISTER_NODE(CreateRenderPassNode)
+TT_DG_REGISTER_NODE(DrawQuadNode)
+TT_DG_REGISTER_NODE(CreateMaterialNode)
+TT_DG_REGISTER_NODE(MaterialSetImageNode)
@@ -1,14 +1,19 @@
 #pragma once
 
 #include "dg.h"
+#include "rendering_context.h"
+#include "rendering_shaders.h"
 
 #include "../tt_rendering/tt_rendering.h"
 #include "../tt_cpplib/tt_cgmath.h"
 
 namespace RenderGraphGlobals {
     // TODO: This is clearly not good. The parent application must set this before computing anything in the graph.
-    extern TTRendering::RenderingContext* gContext;
+    // Use ForwardingRenderGraphContext to render with a TTRendering context, or RecordingRenderGraphContext to run without a GPU.
+    extern RenderGraphContext* gContext;
     extern TTRendering::MeshHandle* gQuadMesh;
+    // Optional. When set, and the context compiles shader source, CreateMaterialNode takes its shader sources from here, see ShaderSourceCache.
+    extern ShaderSourceCache* gShaderSources;
 }
 
 // TODO: Is this really the only way to provide a string as template argument? Should the template become a massive macro instead...?
@@ -27,13 +32,14 @@ namespace {
     char Vec4[] = "Vec4";
 }
 
-// Note: all of these nodes allocate GPU resources without cleaning up after themselves.
-// Pipeline graphs are intended to be computed only once, in their entirety, and then never touched again.
+// Nodes that allocate GPU resources keep them while recomputing with the same settings, and release them when the settings change or the node is destroyed.
+// Materials are still created anew on every compute and never released.
 
 // These sockets are serializable:
 template<typename T, const char* NAME> class NumericSocket : public Socket<T, NumericSocket<T, NAME>, NAME> {
 public:
     using Socket<T, NumericSocket<T, NAME>, NAME>::Socket; 
+    static constexpr bool sEarlyCutoff = true;
 
 protected:
     bool deserializeValue(const TTJson::Value& value) override {
@@ -62,6 +68,9 @@ protected:
 class StringSocket : public Socket<std::string, StringSocket, String> {
     using Socket::Socket; 
 
+public:
+    static constexpr bool sEarlyCutoff = true;
+
 protected:
     bool deserializeValue(const TTJson::Value& value) override {
         if (!value.isString())
@@ -123,14 +132,37 @@ typedef NumericSocket<TTRendering::ImageTiling, ImageTiling> ImageTilingSocket;
 typedef NumericSocket<TTRendering::MaterialBlendMode, MaterialBlendMode> MaterialBlendModeSocket;
 
 // These sockets are NOT serializable:
-class ImageHandleSocket : public Socket<TTRendering::ImageHandle, ImageHandleSocket, ImageHandle> { using Socket::Socket; };
-class FramebufferHandleSocket : public Socket<TTRendering::FramebufferHandle, FramebufferHandleSocket, FramebufferHandle> { using Socket::Socket; };
+// Nodes that keep their resource when recomputed set the same handle again, early cutoff then keeps that from rippling downstream.
+class ImageHandleSocket : public Socket<TTRendering::ImageHandle, ImageHandleSocket, ImageHandle> { using Socket::Socket; public: static constexpr bool sEarlyCutoff = true; };
+class FramebufferHandleSocket : public Socket<TTRendering::FramebufferHandle, FramebufferHandleSocket, FramebufferHandle> { using Socket::Socket; public: static constexpr bool sEarlyCutoff = true; };
 class MaterialHandleSocket : public Socket<TTRendering::MaterialHandle, MaterialHandleSocket, MaterialHandle> { using Socket::Socket; };
-class RenderPassSocket : public Socket<TTRendering::RenderPass*, RenderPassSocket, RenderPass> { using Socket::Socket; };
+class RenderPassSocket : public Socket<TTRendering::RenderPass*, RenderPassSocket, RenderPass> { using Socket::Socket; public: static constexpr bool sEarlyCutoff = true; };
+
+// Where the window size enters the graph. The application sets it on resize, and only the nodes connected to it recompute.
+class ResolutionNode final : public Node {
+public:
+    std::string typeName() const override { return "ResolutionNode"; }
+
+    U16Socket& windowWidth;
+    U16Socket& windowHeight;
+    U16Socket& width;
+    U16Socket& height;
+
+    ResolutionNode(const std::string& label = "");
+
+    void setResolution(unsigned int width, unsigned int height);
+    // Connects every CreateImageNode with a non-zero factor that is not connected to a resolution yet.
+    // Returns the number of images connected.
+    size_t connectScaledImages(const std::vector<Node*>& nodes);
+
+private:
+    void _compute() override;
+};
 
 class CreateImageNode final : public Node {
 public:
     std::string typeName() const override { return "CreateImageNode"; }
+    bool computeOnOwningThread() const override { return true; }
 
     U16Socket& width;
     U16Socket& height;
@@ -138,31 +170,64 @@ public:
     ImageInterpolationSocket& interpolation;
     ImageTilingSocket& tiling;
     U16Socket& factor;
+    // Connect to a ResolutionNode to size the image relative to the window, see factor.
+    // Without a connection the resolution is read from gContext, which the graph can not see change.
+    U16Socket& resolutionWidth;
+    U16Socket& resolutionHeight;
+    // When connected, the image shares the memory of that image instead of allocating its own, see TransientImagePlanner.
+    ImageHandleSocket& alias;
     ImageHandleSocket& result;
 
     CreateImageNode(const std::string& label = "");
+    ~CreateImageNode();
 
 private:
+    struct Settings {
+        unsigned int width;
+        unsigned int height;
+        TTRendering::ImageFormat format;
+        TTRendering::ImageInterpolation interpolation;
+        TTRendering::ImageTiling tiling;
+
+        bool operator==(const Settings& rhs) const {
+            return width == rhs.width && height == rhs.height && format == rhs.format && interpolation == rhs.interpolation && tiling == rhs.tiling;
+        }
+    };
+
+    // The image we allocated, and what with, so recomputing with the same settings keeps it and other settings replace it.
+    TTRendering::ImageHandle _image = TTRendering::ImageHandle::Null;
+    Settings _settings {};
+
+    void _release();
     void _compute() override;
 };
 
 class CreateFramebufferNode final : public Node {
 public:
     std::string typeName() const override { return "CreateFramebufferNode"; }
+    bool computeOnOwningThread() const override { return true; }
 
     SocketArray<ImageHandleSocket>& colorBuffers;
     ImageHandleSocket& depthBuffer;
     FramebufferHandleSocket& result;
 
     CreateFramebufferNode(const std::string& label = "");
+    ~CreateFramebufferNode();
 
 private:
+    // The framebuffer we allocated, and the attachments it was allocated with.
+    TTRendering::FramebufferHandle _framebuffer = TTRendering::FramebufferHandle::Null;
+    std::vector<TTRendering::ImageHandle> _colorBuffers;
+    TTRendering::ImageHandle _depthBuffer = TTRendering::ImageHandle::Null;
+
+    void _release();
     void _compute() override;
 };
 
 class CreateMaterialNode final : public Node {
 public:
     std::string typeName() const override { return "CreateMaterialNode"; }
+    bool computeOnOwningThread() const override { return true; }
 
     SocketArray<StringSocket>& shaderPaths;
     MaterialBlendModeSocket& blendMode;
@@ -177,6 +242,7 @@ private:
 class MaterialSetImageNode final : public Node {
 public:
     std::string typeName() const override { return "MaterialSetImageNode"; }
+    bool computeOnOwningThread() const override { return true; }
 
     MaterialHandleSocket& material;
     ImageHandleSocket& image;
@@ -191,6 +257,7 @@ private:
 class CreateRenderPassNode final : public Node {
 public:
     std::string typeName() const override { return "CreateRenderPassNode"; }
+    bool computeOnOwningThread() const override { return true; }
 
     Vec4Socket& clearColor;
     FramebufferHandleSocket& framebuffer;
@@ -198,19 +265,33 @@ public:
 
     CreateRenderPassNode(const std::string& label = "");
 
+    // Starts over with a new pass on the next compute, so the draws connected to us queue into an empty one.
+    // Draws only ever add to the queue, so this is how draws that changed or were disconnected get out of it.
+    void resetDrawQueue();
+
 private:
+    // Owned by us, and updated in place when recomputed so the draws queued into it stay.
+    std::unique_ptr<TTRendering::RenderPass> _renderPass;
+
     void _compute() override;
 };
 
 class DrawQuadNode final : public Node {
 public:
     std::string typeName() const override { return "DrawQuadNode"; }
+    bool computeOnOwningThread() const override { return true; }
 
     MaterialHandleSocket& material;
     RenderPassSocket& renderPass;
 
     DrawQuadNode(const std::string& label = "");
 
+    // Whether the last compute queued into the same pass as the one before, which then holds our draw twice, see CreateRenderPassNode::resetDrawQueue.
+    bool queuedTwice() const { return _queuedTwice; }
+
 private:
+    const TTRendering::RenderPass* _queuedInto = nullptr;
+    bool _queuedTwice = false;
+
     void _compute() override;
 };
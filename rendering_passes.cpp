@@ -0,0 +1,234 @@
+#include "rendering_passes.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace {
+    // Follows the connections of an input back to the output that provides its value.
+    template<typename SocketT> const SocketT* origin(const SocketT& socket) {
+        const SocketT* current = &socket;
+        while (current->input())
+            current = current->input();
+        return current->isOutput() ? current : nullptr;
+    }
+
+    template<typename NodeT, typename SocketT> NodeT* producer(const SocketT& socket) {
+        const SocketT* output = origin(socket);
+        return output ? dynamic_cast<NodeT*>(&output->node()) : nullptr;
+    }
+
+    // Appends image unless the last call for this list already did, marks are (image, list index).
+    void appendOnce(std::vector<CreateImageNode*>& images, size_t index, CreateImageNode* image, std::unordered_map<const CreateImageNode*, size_t>& marks) {
+        auto it = marks.find(image);
+        if (it != marks.end() && it->second == index)
+            return;
+        marks[image] = index;
+        images.push_back(image);
+    }
+}
+
+void RenderPassScheduler::schedule(const std::vector<Node*>& nodes) {
+    _passes.clear();
+    _writes.clear();
+    _reads.clear();
+    _dependencies.clear();
+    _draws.clear();
+    _hazards.clear();
+
+    std::vector<CreateRenderPassNode*> passes;
+    std::unordered_map<const Node*, size_t> passIndices;
+    for (Node* node : nodes) {
+        if (CreateRenderPassNode* pass = dynamic_cast<CreateRenderPassNode*>(node)) {
+            passIndices[pass] = passes.size();
+            passes.push_back(pass);
+        }
+    }
+    size_t count = passes.size();
+
+    // Passes draw to the images of their framebuffer.
+    std::vector<std::vector<CreateImageNode*>> writes(count);
+    std::unordered_map<const CreateImageNode*, size_t> marks;
+    for (size_t i = 0; i < count; ++i) {
+        CreateFramebufferNode* framebuffer = producer<CreateFramebufferNode>(passes[i]->framebuffer);
+        if (!framebuffer) continue;
+        for (const ImageHandleSocket* colorBuffer : framebuffer->colorBuffers.children())
+            if (CreateImageNode* image = producer<CreateImageNode>(*colorBuffer))
+                appendOnce(writes[i], i, image, marks);
+        if (CreateImageNode* image = producer<CreateImageNode>(framebuffer->depthBuffer))
+            appendOnce(writes[i], i, image, marks);
+    }
+
+    // And sample the images set on the materials they draw with.
+    std::unordered_map<const MaterialHandleSocket*, std::vector<MaterialSetImageNode*>> materialImages;
+    for (Node* node : nodes) {
+        MaterialSetImageNode* setImage = dynamic_cast<MaterialSetImageNode*>(node);
+        if (!setImage) continue;
+        if (const MaterialHandleSocket* material = origin(setImage->material))
+            materialImages[material].push_back(setImage);
+    }
+    std::vector<std::vector<CreateImageNode*>> reads(count);
+    std::vector<std::vector<Node*>> draws(count);
+    marks.clear();
+    for (Node* node : nodes) {
+        DrawQuadNode* draw = dynamic_cast<DrawQuadNode*>(node);
+        if (!draw) continue;
+        const RenderPassSocket* pass = origin(draw->renderPass);
+        if (!pass) continue;
+        const auto& passIt = passIndices.find(&pass->node());
+        if (passIt == passIndices.end()) continue;
+        size_t i = passIt->second;
+        draws[i].push_back(draw);
+        const MaterialHandleSocket* material = origin(draw->material);
+        const auto& imagesIt = material ? materialImages.find(material) : materialImages.end();
+        if (imagesIt == materialImages.end()) continue;
+        // A material drawn into several passes is listed with each, so its images are set as long as one of them is live.
+        for (MaterialSetImageNode* setImage : imagesIt->second) {
+            draws[i].push_back(setImage);
+            if (CreateImageNode* image = producer<CreateImageNode>(setImage->image))
+                appendOnce(reads[i], i, image, marks);
+        }
+    }
+
+    // A pass comes after every other pass that draws to an image it samples.
+    std::unordered_map<const CreateImageNode*, std::vector<size_t>> producers;
+    for (size_t i = 0; i < count; ++i)
+        for (CreateImageNode* image : writes[i])
+            producers[image].push_back(i);
+    std::vector<std::vector<size_t>> dependencies(count);
+    std::vector<std::vector<size_t>> consumers(count);
+    std::vector<size_t> seen(count, SIZE_MAX);
+    for (size_t i = 0; i < count; ++i) {
+        for (CreateImageNode* image : reads[i]) {
+            const auto& it = producers.find(image);
+            if (it == producers.end()) continue;
+            for (size_t producer : it->second) {
+                if (producer == i || seen[producer] == i) continue;
+                seen[producer] = i;
+                dependencies[i].push_back(producer);
+                consumers[producer].push_back(i);
+            }
+        }
+    }
+
+    std::vector<size_t> pending(count);
+    std::vector<size_t> order;
+    order.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        pending[i] = dependencies[i].size();
+        if (!pending[i])
+            order.push_back(i);
+    }
+    for (size_t cursor = 0; cursor < order.size(); ++cursor)
+        for (size_t consumer : consumers[order[cursor]])
+            if (--pending[consumer] == 0)
+                order.push_back(consumer);
+    for (size_t i = 0; i < count; ++i)
+        if (pending[i])
+            order.push_back(i);
+
+    std::vector<size_t> positions(count);
+    for (size_t position = 0; position < count; ++position)
+        positions[order[position]] = position;
+    _passes.reserve(count);
+    _writes.reserve(count);
+    _reads.reserve(count);
+    _dependencies.reserve(count);
+    _draws.reserve(count);
+    for (size_t i : order) {
+        _passes.push_back(passes[i]);
+        _draws.push_back(std::move(draws[i]));
+        _writes.push_back(std::move(writes[i]));
+        _reads.push_back(std::move(reads[i]));
+        std::vector<size_t>& dependencyPositions = dependencies[i];
+        for (size_t& dependency : dependencyPositions)
+            dependency = positions[dependency];
+        _dependencies.push_back(std::move(dependencyPositions));
+    }
+
+    // Every image a pass samples should have been drawn by then, so it must not be drawn to by this pass or one that comes later.
+    for (size_t position = 0; position < count; ++position) {
+        for (CreateImageNode* image : _reads[position]) {
+            const auto& it = producers.find(image);
+            if (it == producers.end()) continue;
+            for (size_t producer : it->second)
+                if (positions[producer] >= position)
+                    _hazards.push_back({ _passes[position], passes[producer], image });
+        }
+    }
+
+    _updateSinks();
+}
+
+void RenderPassScheduler::cull(const std::vector<CreateRenderPassNode*>& outputs) {
+    size_t count = _passes.size();
+    std::unordered_map<const CreateRenderPassNode*, size_t> positions;
+    for (size_t position = 0; position < count; ++position)
+        positions[_passes[position]] = position;
+
+    // Everything an output depends on is live.
+    std::vector<bool> live(count, false);
+    std::vector<size_t> worklist;
+    for (const CreateRenderPassNode* output : outputs) {
+        const auto& it = positions.find(output);
+        if (it == positions.end() || live[it->second]) continue;
+        live[it->second] = true;
+        worklist.push_back(it->second);
+    }
+    while (!worklist.empty()) {
+        size_t position = worklist.back();
+        worklist.pop_back();
+        for (size_t dependency : _dependencies[position]) {
+            if (live[dependency]) continue;
+            live[dependency] = true;
+            worklist.push_back(dependency);
+        }
+    }
+
+    std::vector<size_t> remap(count, SIZE_MAX);
+    size_t kept = 0;
+    for (size_t position = 0; position < count; ++position) {
+        if (!live[position]) continue;
+        remap[position] = kept;
+        _passes[kept] = _passes[position];
+        _writes[kept].swap(_writes[position]);
+        _reads[kept].swap(_reads[position]);
+        _dependencies[kept].swap(_dependencies[position]);
+        _draws[kept].swap(_draws[position]);
+        kept++;
+    }
+    _passes.resize(kept);
+    _writes.resize(kept);
+    _reads.resize(kept);
+    _dependencies.resize(kept);
+    _draws.resize(kept);
+    // Live passes only depend on live passes.
+    for (std::vector<size_t>& dependencies : _dependencies)
+        for (size_t& dependency : dependencies)
+            dependency = remap[dependency];
+    _hazards.erase(std::remove_if(_hazards.begin(), _hazards.end(), [&](const Hazard& hazard) { return !live[positions[hazard.reader]]; }), _hazards.end());
+
+    _updateSinks();
+}
+
+std::vector<CreateRenderPassNode*> RenderPassScheduler::presentedPasses(const std::vector<Node*>& nodes) {
+    std::vector<CreateRenderPassNode*> result;
+    for (Node* node : nodes) {
+        CreateRenderPassNode* pass = dynamic_cast<CreateRenderPassNode*>(node);
+        if (pass && !producer<CreateFramebufferNode>(pass->framebuffer))
+            result.push_back(pass);
+    }
+    return result;
+}
+
+void RenderPassScheduler::_updateSinks() {
+    _sinks.clear();
+    std::unordered_set<const Node*> added;
+    for (size_t position = 0; position < _passes.size(); ++position) {
+        _sinks.push_back(_passes[position]);
+        for (Node* node : _draws[position])
+            if (added.insert(node).second)
+                _sinks.push_back(node);
+    }
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "rendering_nodes.h"
+
+// Orders the render passes of a pipeline graph by the images they exchange.
+// A pass draws to the images of its framebuffer and samples the images set on the materials drawn into it,
+// so it depends on every other pass that draws an image it samples.
+class RenderPassScheduler {
+public:
+    // A pass that samples an image which is drawn to by itself or by a pass that runs after it,
+    // so it reads what was left in the image by the previous frame.
+    struct Hazard {
+        CreateRenderPassNode* reader;
+        CreateRenderPassNode* writer;
+        CreateImageNode* image;
+    };
+
+private:
+    // All of these are in execution order.
+    std::vector<CreateRenderPassNode*> _passes;
+    std::vector<std::vector<CreateImageNode*>> _writes;
+    std::vector<std::vector<CreateImageNode*>> _reads;
+    // Positions of the passes every pass has to wait for.
+    std::vector<std::vector<size_t>> _dependencies;
+    // The draws into every pass, and the nodes setting images on the materials they draw with.
+    std::vector<std::vector<Node*>> _draws;
+    std::vector<Hazard> _hazards;
+    std::vector<Node*> _sinks;
+
+    void _updateSinks();
+
+public:
+    // Builds the dependencies between the passes in nodes and sorts them, in time linear to the number of passes, images and draws.
+    // Passes that depend on each other have no valid order, they are kept in graph order at the end and reported as hazards.
+    void schedule(const std::vector<Node*>& nodes);
+    // Drops every scheduled pass that none of outputs depends on, along with its draws and hazards.
+    void cull(const std::vector<CreateRenderPassNode*>& outputs);
+    // The passes in nodes that draw to the window rather than to a framebuffer of the graph, usually what should be passed to cull.
+    static std::vector<CreateRenderPassNode*> presentedPasses(const std::vector<Node*>& nodes);
+
+    const std::vector<CreateRenderPassNode*>& passes() const { return _passes; }
+    const std::vector<CreateImageNode*>& writes(size_t position) const { return _writes[position]; }
+    const std::vector<CreateImageNode*>& reads(size_t position) const { return _reads[position]; }
+    const std::vector<size_t>& dependencies(size_t position) const { return _dependencies[position]; }
+    // The DrawQuadNodes drawing into the pass, and the MaterialSetImageNodes on the materials they draw with.
+    const std::vector<Node*>& draws(size_t position) const { return _draws[position]; }
+    const std::vector<Hazard>& hazards() const { return _hazards; }
+    // The nodes to evaluate (see GraphSchedule::evaluate) to record the scheduled passes: the passes and their draws.
+    // Nodes that only feed passes that were culled are not upstream of these, so they are never computed.
+    const std::vector<Node*>& sinks() const { return _sinks; }
+};
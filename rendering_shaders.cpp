@@ -0,0 +1,110 @@
+#include "rendering_shaders.h"
+#include "rendering_nodes.h"
+
+#include <fstream>
+#include <sstream>
+
+ShaderSourceCache::ShaderSourceCache(ThreadPool& pool) : _pool(pool) {}
+
+ShaderSourceCache::~ShaderSourceCache() {
+    // The pool outlives us, but the tasks it is still running write to our entries.
+    std::unique_lock<std::mutex> lock(_mutex);
+    _resolved.wait(lock, [this]() { return _pending == 0; });
+}
+
+void ShaderSourceCache::request(const std::string& path) {
+    Entry* entry;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto& slot = _entries[path];
+        if (slot) return;
+        slot.reset(new Entry);
+        slot->source.path = path;
+        entry = slot.get();
+        ++_pending;
+    }
+    _pool.submit([this, entry]() { _load(*entry); });
+}
+
+void ShaderSourceCache::request(const std::vector<Node*>& nodes) {
+    for (Node* node : nodes)
+        if (CreateMaterialNode* material = dynamic_cast<CreateMaterialNode*>(node))
+            for (StringSocket* shaderPath : material->shaderPaths.children())
+                request(shaderPath->value());
+}
+
+const ShaderSourceCache::Source& ShaderSourceCache::wait(const std::string& path) {
+    request(path);
+    std::unique_lock<std::mutex> lock(_mutex);
+    const Entry& entry = *_entries[path];
+    _resolved.wait(lock, [&entry]() { return entry.resolved; });
+    return entry.source;
+}
+
+void ShaderSourceCache::_load(Entry& entry) {
+    // Read and hash without holding the lock, nobody looks at the entry until it is resolved.
+    Source& source = entry.source;
+    std::ifstream in(source.path, std::ios::binary);
+    if (in) {
+        std::ostringstream text;
+        text << in.rdbuf();
+        source.text = text.str();
+        source.hash = hash(source.text);
+        source.loaded = true;
+    }
+    source.canonicalPath = source.path;
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (source.loaded) {
+        bool duplicate = false;
+        auto range = _contents.equal_range(source.hash);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (it->second->source.text == source.text) {
+                source.canonicalPath = it->second->source.canonicalPath;
+                duplicate = true;
+                break;
+            }
+        }
+        if (!duplicate) {
+            _contents.emplace(source.hash, &entry);
+            ++_uniqueContents;
+        }
+        _bytes += source.text.size();
+    }
+    entry.resolved = true;
+    --_pending;
+    _resolved.notify_all();
+}
+
+bool ShaderSourceCache::ready() const {
+    return pendingCount() == 0;
+}
+
+size_t ShaderSourceCache::pendingCount() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _pending;
+}
+
+size_t ShaderSourceCache::pathCount() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _entries.size();
+}
+
+size_t ShaderSourceCache::uniqueContentCount() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _uniqueContents;
+}
+
+size_t ShaderSourceCache::byteCount() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _bytes;
+}
+
+uint64_t ShaderSourceCache::hash(const std::string& text) {
+    uint64_t result = 14695981039346656037ull;
+    for (unsigned char c : text) {
+        result ^= c;
+        result *= 1099511628211ull;
+    }
+    return result;
+}
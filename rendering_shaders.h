@@ -0,0 +1,70 @@
+#pragma once
+
+#include "dg_threadpool.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class Node;
+
+// Reads and hashes shader files on a thread pool ahead of the materials that need them.
+// Every path is read once, and paths with identical contents resolve to the same canonical path, so each distinct shader stage is fetched once.
+// The contents are handed to contexts that compile stages from source (see RenderGraphContext::compilesShaderSource), so the file is not read again.
+// Only touches the file system, so it runs (and can be measured) without a GPU.
+class ShaderSourceCache {
+public:
+    struct Source {
+        std::string path;
+        std::string text;
+        uint64_t hash = 0;
+        // False if the file could not be read.
+        bool loaded = false;
+        // The first path that was read with the same contents, or path itself.
+        std::string canonicalPath;
+    };
+
+private:
+    struct Entry {
+        Source source;
+        bool resolved = false;
+    };
+
+    ThreadPool& _pool;
+    mutable std::mutex _mutex;
+    std::condition_variable _resolved;
+    std::unordered_map<std::string, std::unique_ptr<Entry>> _entries;
+    // Loaded entries by the hash of their contents, compared in full when the hashes match.
+    std::unordered_multimap<uint64_t, const Entry*> _contents;
+    size_t _pending = 0;
+    size_t _uniqueContents = 0;
+    size_t _bytes = 0;
+
+    void _load(Entry& entry);
+
+public:
+    explicit ShaderSourceCache(ThreadPool& pool);
+    // Waits for the reads still in flight.
+    ~ShaderSourceCache();
+
+    // Starts reading path in the background, unless it was requested before.
+    void request(const std::string& path);
+    // Requests the shader paths of every CreateMaterialNode in nodes.
+    void request(const std::vector<Node*>& nodes);
+    // Requests path if needed, and blocks until it is read. The result stays valid for the lifetime of the cache.
+    const Source& wait(const std::string& path);
+
+    // Whether every requested file has been read, e.g. to hold off computing materials until then.
+    bool ready() const;
+    size_t pendingCount() const;
+    size_t pathCount() const;
+    size_t uniqueContentCount() const;
+    size_t byteCount() const;
+
+    // 64 bit FNV-1a.
+    static uint64_t hash(const std::string& text);
+};
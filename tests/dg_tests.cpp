@@ -0,0 +1,301 @@
+// Tests for the graph core that do not need a window or GL context.
+// Each test returns false on the first failed CHECK, main runs them all and reports the failures.
+
+#include "../dg.h"
+#include "../dg_dense.h"
+#include "../dg_json_stream.h"
+#include "../dg_schedule.h"
+#include "../dg_threadpool.h"
+
+#include <atomic>
+#include <cstdio>
+#include <sstream>
+
+#define CHECK(condition) do { if (!(condition)) { printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); return false; } } while (0)
+
+namespace {
+    char TestF32[] = "TestF32";
+}
+
+class F32TestSocket : public Socket<float, F32TestSocket, TestF32> {
+public:
+    using Socket::Socket;
+};
+
+// Two outputs that each depend on one input, so one can be dirty while the other is clean.
+class SplitF32Node final : public Node {
+public:
+    std::string typeName() const override { return "SplitF32Node"; }
+
+    F32TestSocket& a;
+    F32TestSocket& b;
+    F32TestSocket& resultA;
+    F32TestSocket& resultB;
+    std::atomic<int> computes { 0 };
+
+    SplitF32Node(const std::string& label = "")
+        : Node(label)
+        , a(addInput<F32TestSocket>("a", 1.0f))
+        , b(addInput<F32TestSocket>("b", 2.0f))
+        , resultA(addOutput<F32TestSocket>("resultA", 0.0f))
+        , resultB(addOutput<F32TestSocket>("resultB", 0.0f)) {
+        _declareDependencies(resultA, { &a });
+        _declareDependencies(resultB, { &b });
+        _initializing = false;
+    }
+
+private:
+    void _compute() override {
+        ++computes;
+        resultA.setValue(a.value());
+        resultB.setValue(b.value());
+    }
+};
+
+class AddF32TestNode final : public Node {
+public:
+    std::string typeName() const override { return "AddF32TestNode"; }
+
+    F32TestSocket& lhs;
+    F32TestSocket& rhs;
+    F32TestSocket& result;
+    std::atomic<int> computes { 0 };
+
+    AddF32TestNode(const std::string& label = "")
+        : Node(label)
+        , lhs(addInput<F32TestSocket>("lhs", 0.0f))
+        , rhs(addInput<F32TestSocket>("rhs", 0.0f))
+        , result(addOutput<F32TestSocket>("result", 0.0f)) {
+        _initializing = false;
+    }
+
+private:
+    void _compute() override {
+        ++computes;
+        result.setValue(lhs.value() + rhs.value());
+    }
+};
+
+class SumF32TestNode final : public Node {
+public:
+    std::string typeName() const override { return "SumF32TestNode"; }
+
+    SocketArray<F32TestSocket>& values;
+    F32TestSocket& result;
+
+    SumF32TestNode(const std::string& label = "")
+        : Node(label)
+        , values(addArrayInput<F32TestSocket>("values", 0.0f))
+        , result(addOutput<F32TestSocket>("result", 0.0f)) {
+        _initializing = false;
+    }
+
+private:
+    void _compute() override {
+        float sum = 0.0f;
+        for (F32TestSocket* value : values.children())
+            sum += value->value();
+        result.setValue(sum);
+    }
+};
+
+// Counts the inputs it is told about, like AsyncNode does to cancel its work.
+class WatchingF32Node final : public Node {
+public:
+    std::string typeName() const override { return "WatchingF32Node"; }
+
+    F32TestSocket& value;
+    F32TestSocket& result;
+    int changes = 0;
+
+    WatchingF32Node(const std::string& label = "")
+        : Node(label)
+        , value(addInput<F32TestSocket>("value", 0.0f))
+        , result(addOutput<F32TestSocket>("result", 0.0f)) {
+        _initializing = false;
+    }
+
+private:
+    void _compute() override { result.setValue(value.value()); }
+    void _socketChanged(const ISocket& socket) override { ++changes; }
+};
+
+namespace {
+    // A node whose read output is clean is not computed by its readers, even though it is dirty for its other output.
+    // Two consumers run in parallel, so computing it from either of them would also be a race.
+    bool testCleanOutputReadInParallel() {
+        GraphArena arena;
+        SplitF32Node& split = arena.create<SplitF32Node>("split");
+        AddF32TestNode& first = arena.create<AddF32TestNode>("first");
+        AddF32TestNode& second = arena.create<AddF32TestNode>("second");
+        first.lhs.setInput(split.resultA);
+        second.lhs.setInput(split.resultA);
+        GraphSchedule schedule;
+        schedule.compile({ &split, &first, &second });
+        ThreadPool pool(4);
+
+        schedule.evaluateParallel({ &first, &second }, pool);
+        CHECK(split.computes == 1);
+        CHECK(first.result.value() == 1.0f && second.result.value() == 1.0f);
+
+        for (int i = 0; i < 100; ++i) {
+            split.b.setValue(3.0f + (float)i);
+            first.rhs.setValue((float)i);
+            second.rhs.setValue((float)i);
+            schedule.evaluateParallel({ &first, &second }, pool);
+            CHECK(split.computes == 1);
+            CHECK(split.isDirty());
+            CHECK(!first.isDirty() && !second.isDirty());
+        }
+        CHECK(first.result.value() == 100.0f && second.result.value() == 100.0f);
+
+        // Reading the dirty output does compute it.
+        CHECK(split.resultB.value() == 102.0f);
+        CHECK(split.computes == 2);
+        return true;
+    }
+
+    // GraphSchedule::markNeeded leaves out nodes that are only read through clean outputs, and the nodes feeding only them.
+    // Nothing else may compute them behind its back, serially or in parallel.
+    bool testSkippedNodesStayUncomputed() {
+        for (bool parallel : { false, true }) {
+            GraphArena arena;
+            AddF32TestNode& feed = arena.create<AddF32TestNode>("feed");
+            SplitF32Node& split = arena.create<SplitF32Node>("split");
+            AddF32TestNode& middle = arena.create<AddF32TestNode>("middle");
+            AddF32TestNode& sink = arena.create<AddF32TestNode>("sink");
+            AddF32TestNode& unread = arena.create<AddF32TestNode>("unread");
+            split.b.setInput(feed.result);
+            middle.lhs.setInput(split.resultA);
+            sink.lhs.setInput(middle.result);
+            sink.rhs.setInput(split.resultA);
+            unread.lhs.setInput(split.resultB);
+            GraphSchedule schedule;
+            schedule.compile({ &feed, &split, &middle, &sink, &unread });
+            ThreadPool pool(4);
+            auto evaluate = [&]() {
+                if (parallel)
+                    schedule.evaluateParallel({ &sink }, pool);
+                else
+                    schedule.evaluate({ &sink });
+            };
+
+            evaluate();
+            CHECK(feed.computes == 1 && split.computes == 1 && sink.computes == 1 && unread.computes == 0);
+
+            // Only resultB and what reads it are dirty, the sink's own input is the only change it sees.
+            feed.lhs.setValue(5.0f);
+            middle.rhs.setValue(1.0f);
+            evaluate();
+            CHECK(feed.computes == 1 && split.computes == 1 && unread.computes == 0);
+            CHECK(middle.computes == 2 && sink.computes == 2);
+            CHECK(feed.isDirty() && split.isDirty() && unread.isDirty());
+            CHECK(sink.result.value() == 3.0f);
+
+            // Once resultA does change, everything upstream of it computes once.
+            split.a.setValue(2.0f);
+            evaluate();
+            CHECK(feed.computes == 2 && split.computes == 2 && middle.computes == 3 && sink.computes == 3);
+            CHECK(unread.computes == 0);
+            CHECK(sink.result.value() == 5.0f);
+        }
+        return true;
+    }
+
+    // A DenseGraph keeps the dirty outputs and dependencies in its own arrays, those have to behave like the sockets do,
+    // and hand their state back when detached. Node types that listen for socket changes still hear about every one.
+    bool testDenseOutputsAndWatchers() {
+        GraphArena arena;
+        WatchingF32Node& watcher = arena.create<WatchingF32Node>("watcher");
+        SplitF32Node& split = arena.create<SplitF32Node>("split");
+        AddF32TestNode& readsA = arena.create<AddF32TestNode>("readsA");
+        AddF32TestNode& readsB = arena.create<AddF32TestNode>("readsB");
+        split.a.setInput(watcher.result);
+        readsA.lhs.setInput(split.resultA);
+        readsB.lhs.setInput(split.resultB);
+        readsA.result.value();
+        readsB.result.value();
+        CHECK(watcher.changes == 0);
+
+        DenseGraph dense;
+        dense.build({ &watcher, &split, &readsA, &readsB });
+        for (int i = 0; i < 3; ++i) {
+            watcher.value.setValue(5.0f + (float)i);
+            CHECK(readsA.isDirty() && !readsB.isDirty());
+        }
+        CHECK(watcher.changes == 3);
+        CHECK(readsA.result.value() == 7.0f);
+        CHECK(readsB.result.value() == 2.0f);
+        CHECK(split.computes == 2);
+
+        // resultB stays clean, also once the flags are back in the sockets, so reading it does not compute split.
+        watcher.value.setValue(1.0f);
+        CHECK(split.isDirty() && readsA.isDirty() && !readsB.isDirty());
+        dense.detach();
+        CHECK(split.isDirty() && readsA.isDirty() && !readsB.isDirty());
+        CHECK(split.resultB.value() == 2.0f);
+        CHECK(split.computes == 2);
+        CHECK(readsA.result.value() == 1.0f);
+        CHECK(split.computes == 3);
+        CHECK(watcher.changes == 4);
+        return true;
+    }
+
+    // Elements of arrays share the label of their array, and the labels of a type are the same symbols on every node.
+    // Looking up sockets by label works whether or not the first node asked had sockets added.
+    bool testSocketLabels() {
+        GraphArena arena;
+        SumF32TestNode& sum = arena.create<SumF32TestNode>("sum");
+        for (int i = 0; i < 3; ++i)
+            sum.values.appendNew().setValue((float)i);
+        CHECK(sum.values.children()[2]->label() == "values[2]");
+        CHECK(sum.values.children()[2]->labelId() == sum.values.labelId());
+        CHECK(sum.values.label() == "values");
+        CHECK(sum.result.value() == 3.0f);
+
+        SplitF32Node& modified = arena.create<SplitF32Node>("modified");
+        F32TestSocket& extra = modified.addInput<F32TestSocket>("extra", 0.0f);
+        SplitF32Node& plain = arena.create<SplitF32Node>("plain");
+        CHECK(modified.a.labelId() == plain.a.labelId());
+        CHECK(modified.findSocket(SymbolTable::intern("extra"), false) == &extra);
+        CHECK(modified.findSocket(SymbolTable::intern("resultB"), true) == &modified.resultB);
+        CHECK(plain.findSocket(SymbolTable::intern("b"), false) == &plain.b);
+        CHECK(plain.findSocket(SymbolTable::intern("extra"), false) == nullptr);
+        CHECK(plain.findSocket(SymbolTable::intern("resultA"), true) == &plain.resultA);
+        return true;
+    }
+
+    // Socket values nested deeper than JsonReader::sMaxValueDepth fail with an error instead of recursing on.
+    bool testJsonValueDepth() {
+        for (uint32_t depth : { JsonReader::sMaxValueDepth, JsonReader::sMaxValueDepth + 1, 100000u }) {
+            std::istringstream in(std::string(depth, '[') + std::string(depth, ']'));
+            JsonReader reader(in);
+            TTJson::Value value;
+            bool ok = reader.readValue(reader.next(), value);
+            CHECK(ok == (depth <= JsonReader::sMaxValueDepth));
+            CHECK(ok == reader.error().empty());
+        }
+        return true;
+    }
+}
+
+int main() {
+    struct Test {
+        const char* name;
+        bool (*run)();
+    };
+    const Test tests[] = {
+        { "clean output read in parallel", testCleanOutputReadInParallel },
+        { "skipped nodes stay uncomputed", testSkippedNodesStayUncomputed },
+        { "dense outputs and watchers", testDenseOutputsAndWatchers },
+        { "socket labels", testSocketLabels },
+        { "json value depth", testJsonValueDepth },
+    };
+    int failed = 0;
+    for (const Test& test : tests) {
+        bool ok = test.run();
+        printf("%s: %s\n", test.name, ok ? "ok" : "FAILED");
+        failed += ok ? 0 : 1;
+    }
+    return failed == 0 ? 0 : 1;
+}